@@ -0,0 +1,450 @@
+// Microbenchmarks for the receive, decode and record hot paths of the client.
+// Results are printed to the console and written as JSON, so that runs on different builds can be compared.
+
+#include <opencv2\highgui\highgui.hpp>
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <vector>
+#include <string>
+#include <algorithm>
+#include <cmath>
+#include <new>
+
+#include "Networking\PacketClient.h"
+#include "Networking\NetworkPacketProcessor.h"
+#include "Networking\PooledMatAllocator.h"
+#include "Networking\VideoEncoder.h"
+#include "Recording\FrameRecorder.h"
+
+#include <ws2tcpip.h>
+#include <windows.h>
+#include <process.h>  // multithreading
+
+using namespace std;
+
+#define DEFAULT_FRAME_COUNT 300 // frames measured per benchmark
+#define RECORDING_FRAME_COUNT 30 // recording hits the disk, so it gets fewer frames
+#define WARMUP_FRAME_COUNT 10 // frames excluded from the measurements (first-touch allocations, decoder initialization)
+#define DEFAULT_OUTPUT_FILE "../Data/BenchmarkResults.json"
+#define RECORDING_DIRECTORY "../Data/Benchmark"
+#define BENCHMARK_CAMERA_INDEX 9 // keeps the benchmark recordings apart from real ones (and keeps the shutter sound quiet - only camera 0 plays it)
+#define JPEG_QUALITY 90
+#define VIDEO_SEQUENCE_FRAMES 60 // one group of pictures of VideoEncoder - looping over the sequence always comes back to its keyframe
+#define VIDEO_PAN_STEP 8 // [pixels] the synthetic scene moves by from frame to frame, so that the predicted frames have motion to code
+
+#pragma region allocation counting
+
+// only allocations made by the measuring thread are counted - the loopback server thread allocates as well
+thread_local size_t AllocationCount = 0;
+thread_local size_t AllocatedBytes = 0;
+
+void* operator new(size_t size)
+{
+	AllocationCount++;
+	AllocatedBytes += size;
+	void* memory = malloc(size ? size : 1);
+	if (!memory) throw std::bad_alloc();
+	return memory;
+}
+
+void operator delete(void* memory) noexcept
+{
+	free(memory);
+}
+
+void* operator new[](size_t size)
+{
+	return operator new(size);
+}
+
+void operator delete[](void* memory) noexcept
+{
+	operator delete(memory);
+}
+
+// cv::Mat buffers are allocated with fastMalloc, not with operator new - count them separately
+class CountingMatAllocator : public cv::MatAllocator
+{
+	const Networking::PooledMatAllocator* _pool; // when set, buffers come from the pool, and only those it had to allocate anew are counted
+
+public:
+	CountingMatAllocator() : _pool(NULL) {}
+
+	void UsePool(const Networking::PooledMatAllocator* pool) { _pool = pool; }
+
+	cv::UMatData* allocate(int dims, const int* sizes, int type, void* data, size_t* step, int flags, cv::UMatUsageFlags usageFlags) const
+	{
+		long long freshAllocations = _pool ? _pool->FreshAllocations() : 0;
+		cv::UMatData* u = _pool ? _pool->allocate(dims, sizes, type, data, step, flags, usageFlags) : cv::Mat::getStdAllocator()->allocate(dims, sizes, type, data, step, flags, usageFlags);
+		if (!data && (!_pool || !Networking::PooledMatAllocator::IsPooled(u->size) || _pool->FreshAllocations() != freshAllocations))
+		{
+			AllocationCount++;
+			AllocatedBytes += u->size;
+		}
+		return u;
+	}
+
+	bool allocate(cv::UMatData* data, int accessFlags, cv::UMatUsageFlags usageFlags) const
+	{
+		return cv::Mat::getStdAllocator()->allocate(data, accessFlags, usageFlags);
+	}
+
+	void deallocate(cv::UMatData* data) const
+	{
+		cv::Mat::getStdAllocator()->deallocate(data);
+	}
+};
+
+#pragma endregion
+
+#pragma region measurement
+
+struct BenchmarkResult
+{
+	string Name;
+	size_t Frames;
+	double TotalSeconds;
+	size_t TotalBytes;
+	vector<double> LatenciesMicroseconds;
+	size_t Allocations;
+	size_t AllocatedBytes;
+
+	double Percentile(double fraction) const
+	{
+		if (LatenciesMicroseconds.empty()) return 0;
+
+		vector<double> sorted(LatenciesMicroseconds);
+		sort(sorted.begin(), sorted.end());
+		return sorted[min(sorted.size() - 1, (size_t)(fraction * sorted.size()))];
+	}
+
+	double Mean() const
+	{
+		if (LatenciesMicroseconds.empty()) return 0;
+
+		double sum = 0;
+		for (double latency : LatenciesMicroseconds) sum += latency;
+		return sum / LatenciesMicroseconds.size();
+	}
+
+	string ToJson() const
+	{
+		ostringstream json;
+		json << "    { \"name\": \"" << Name << "\", \"frames\": " << Frames
+			<< ", \"frames_per_second\": " << Frames / TotalSeconds
+			<< ", \"megabits_per_second\": " << TotalBytes * 8 / TotalSeconds / (1 << 20)
+			<< ", \"latency_us\": { \"mean\": " << Mean() << ", \"p50\": " << Percentile(0.5) << ", \"p90\": " << Percentile(0.9)
+			<< ", \"p99\": " << Percentile(0.99) << ", \"max\": " << Percentile(1.0) << " }"
+			<< ", \"allocations_per_frame\": " << (double)Allocations / Frames
+			<< ", \"allocated_bytes_per_frame\": " << (double)AllocatedBytes / Frames << " }";
+		return json.str();
+	}
+
+	void Print() const
+	{
+		printf("%-24s %8.1f [Hz] %8.1f [Mbps]  latency [us] mean %8.1f p50 %8.1f p99 %8.1f max %8.1f  allocations/frame %6.1f (%8.0f bytes)\n",
+			Name.c_str(), Frames / TotalSeconds, TotalBytes * 8 / TotalSeconds / (1 << 20), Mean(), Percentile(0.5), Percentile(0.99), Percentile(1.0),
+			(double)Allocations / Frames, (double)AllocatedBytes / Frames);
+	}
+};
+
+// runs iteration(frameIndex) warmup + frames times, timing each measured call; iteration returns the number of bytes it moved
+template <typename Iteration>
+BenchmarkResult Measure(const string& name, size_t frames, Iteration iteration)
+{
+	for (size_t i = 0; i < WARMUP_FRAME_COUNT; i++) iteration(i);
+
+	BenchmarkResult result{ name, frames, 0, 0, vector<double>(), 0, 0 };
+	result.LatenciesMicroseconds.reserve(frames); // reserved before counting starts
+
+	LARGE_INTEGER frequency, sessionStart, start, end;
+	QueryPerformanceFrequency(&frequency);
+
+	size_t allocationsBefore = AllocationCount, bytesBefore = AllocatedBytes;
+	QueryPerformanceCounter(&sessionStart);
+	for (size_t i = 0; i < frames; i++)
+	{
+		QueryPerformanceCounter(&start);
+		result.TotalBytes += iteration(WARMUP_FRAME_COUNT + i);
+		QueryPerformanceCounter(&end);
+		result.LatenciesMicroseconds.push_back(1e6 * (end.QuadPart - start.QuadPart) / frequency.QuadPart);
+	}
+	result.TotalSeconds = (double)(end.QuadPart - sessionStart.QuadPart) / frequency.QuadPart;
+	result.Allocations = AllocationCount - allocationsBefore;
+	result.AllocatedBytes = AllocatedBytes - bytesBefore;
+
+	result.Print();
+	return result;
+}
+
+#pragma endregion
+
+#pragma region synthetic frames
+
+// a smooth scene with sensor noise - compresses roughly like real Kinect frames, unlike constant or purely random images
+cv::Mat SyntheticFrame(const Networking::ChannelProperties& channelProperties)
+{
+	cv::Mat frame(channelProperties.Height, channelProperties.Width, channelProperties.PixelType);
+	cv::Mat noise(frame.size(), CV_32FC1);
+	cv::randn(noise, 0, 2);
+
+	for (int row = 0; row < frame.rows; row++)
+	{
+		for (int col = 0; col < frame.cols; col++)
+		{
+			float x = (float)col / frame.cols, y = (float)row / frame.rows;
+			float n = noise.at<float>(row, col);
+			switch (channelProperties.ChannelType)
+			{
+			case Networking::ChannelType::Color:
+				frame.at<cv::Vec3b>(row, col) = cv::Vec3b(cv::saturate_cast<uchar>(200 * x + n), cv::saturate_cast<uchar>(120 + 80 * sin(8 * y) + n), cv::saturate_cast<uchar>(255 * x * y + n));
+				break;
+			case Networking::ChannelType::Depth: // a tilted floor with a bump in the middle, in units of DepthResolution, with invalid (zero) pixels on the border
+			{
+				float depthMm = 1500 + 1500 * y + 400 * exp(-20 * ((x - 0.5f) * (x - 0.5f) + (y - 0.5f) * (y - 0.5f))) + n;
+				bool invalid = col < 8 || col >= frame.cols - 8;
+				frame.at<ushort>(row, col) = invalid ? 0 : cv::saturate_cast<ushort>(depthMm / channelProperties.DepthResolution);
+				break;
+			}
+			case Networking::ChannelType::Ir:
+				frame.at<uchar>(row, col) = cv::saturate_cast<uchar>(60 + 100 * (1 - y) + 4 * n);
+				break;
+			}
+		}
+	}
+
+	return frame;
+}
+
+Networking::NetworkPacket SyntheticPacket(const Networking::ChannelProperties& channelProperties)
+{
+	Networking::NetworkPacket packet;
+	if (channelProperties.ChannelType == Networking::ChannelType::Color)
+		cv::imencode(".jpg", SyntheticFrame(channelProperties), packet.Data, vector<int>{ cv::IMWRITE_JPEG_QUALITY, JPEG_QUALITY });
+	else
+		cv::imencode(".png", SyntheticFrame(channelProperties), packet.Data);
+	packet.Timestamp = { 0, 0 };
+
+	return packet;
+}
+
+// a video stream depends on the frames before - a panning scene, encoded as the ReplayServer would
+vector<Networking::NetworkPacket> SyntheticVideoPackets(const Networking::ChannelProperties& channelProperties)
+{
+	cv::Mat scene = SyntheticFrame(Networking::ChannelProperties(Networking::ChannelType::Color));
+	Networking::VideoEncoder encoder(channelProperties.ChannelType, scene.cols, scene.rows, JPEG_QUALITY, 30);
+
+	vector<Networking::NetworkPacket> packets(VIDEO_SEQUENCE_FRAMES);
+	for (int i = 0; i < VIDEO_SEQUENCE_FRAMES; i++)
+	{
+		int shift = (i * VIDEO_PAN_STEP) % scene.cols;
+		cv::Mat frame = scene;
+		if (shift > 0) cv::hconcat(scene.colRange(shift, scene.cols), scene.colRange(0, shift), frame);
+
+		packets[i].Data = encoder.Encode(frame);
+		packets[i].Timestamp = { 0, 0 };
+	}
+
+	return packets;
+}
+
+#pragma endregion
+
+#pragma region loopback server
+
+struct LoopbackServer
+{
+	SOCKET ListeningSocket;
+	unsigned int Frames;
+	vector<char> Message; // metadata byte followed by Frames copies of one serialized packet
+};
+
+// serializes a packet the way the server on the Jetson board does: timestamp (seconds, milliseconds), 3 byte little-endian size, payload
+vector<char> SerializePacket(const Networking::NetworkPacket& packet)
+{
+	vector<char> serialized(sizeof(long) * 2 + 3);
+	memcpy(&serialized[0], &packet.Timestamp.Seconds, sizeof(long));
+	memcpy(&serialized[sizeof(long)], &packet.Timestamp.Milliseconds, sizeof(long));
+	serialized[2 * sizeof(long)] = packet.Data.size() & 0xFF;
+	serialized[2 * sizeof(long) + 1] = (packet.Data.size() >> 8) & 0xFF;
+	serialized[2 * sizeof(long) + 2] = (packet.Data.size() >> 16) & 0xFF;
+	serialized.insert(serialized.end(), packet.Data.begin(), packet.Data.end());
+
+	return serialized;
+}
+
+unsigned __stdcall LoopbackServerThreadFunction(void* server)
+{
+	LoopbackServer* loopbackServer = (LoopbackServer*)server;
+
+	SOCKET connection = accept(loopbackServer->ListeningSocket, NULL, NULL);
+	if (connection == INVALID_SOCKET) return 1;
+
+	send(connection, &loopbackServer->Message[0], 1, 0);
+	const char* frame = &loopbackServer->Message[1];
+	int frameSize = (int)loopbackServer->Message.size() - 1;
+	for (unsigned int i = 0; i < loopbackServer->Frames; i++)
+	{
+		for (int sent = 0; sent < frameSize; )
+		{
+			int result = send(connection, frame + sent, frameSize - sent, 0);
+			if (result == SOCKET_ERROR) { closesocket(connection); return 1; }
+			sent += result;
+		}
+	}
+
+	closesocket(connection);
+	return 0;
+}
+
+string ChannelName(Networking::ChannelType type)
+{
+	switch (type)
+	{
+	case Networking::ChannelType::Color: return "Color";
+	case Networking::ChannelType::ColorH264: return "ColorH264";
+	case Networking::ChannelType::ColorHevc: return "ColorHevc";
+	case Networking::ChannelType::Depth: return "Depth";
+	default: return "IR";
+	}
+}
+
+BenchmarkResult BenchmarkReceivePacket(Networking::ChannelType type, size_t frames)
+{
+	Networking::ChannelProperties channelProperties(type);
+
+	LoopbackServer server;
+	server.Frames = (unsigned int)(WARMUP_FRAME_COUNT + frames);
+	server.Message.push_back((char)type);
+	auto serialized = SerializePacket(SyntheticPacket(channelProperties));
+	server.Message.insert(server.Message.end(), serialized.begin(), serialized.end());
+
+	server.ListeningSocket = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+	sockaddr_in address = { 0 };
+	address.sin_family = AF_INET;
+	address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	address.sin_port = 0; // let the system pick a free port
+	int addressLength = sizeof(address);
+	if (bind(server.ListeningSocket, (sockaddr*)&address, sizeof(address)) == SOCKET_ERROR || listen(server.ListeningSocket, 1) == SOCKET_ERROR ||
+		getsockname(server.ListeningSocket, (sockaddr*)&address, &addressLength) == SOCKET_ERROR)
+		throw runtime_error("Failed to set up the loopback server: " + to_string(WSAGetLastError()));
+
+	HANDLE serverThread = (HANDLE)_beginthreadex(NULL, 0, &LoopbackServerThreadFunction, &server, 0, NULL);
+
+	Networking::PacketClient client("Benchmark client");
+	if (client.ConnectToServer("127.0.0.1", to_string(ntohs(address.sin_port)).c_str()))
+		throw runtime_error("Failed to connect to the loopback server");
+	client.ReceiveMetadataPacket();
+	client.AllocateBuffers();
+
+	auto result = Measure("ReceivePacket/" + ChannelName(type), frames,
+		[&](size_t) { return client.ReceivePacket().Data.size(); });
+
+	client.CloseConnection();
+	WaitForSingleObject(serverThread, INFINITE);
+	CloseHandle(serverThread);
+	closesocket(server.ListeningSocket);
+
+	return result;
+}
+
+#pragma endregion
+
+int main(int argc, char** argv)
+{
+	if (argc > 3)
+	{
+		cout << "usage: " << argv[0] << " [frames] [output]" << endl
+			<< "[frames] - number of measured frames per benchmark (default " << DEFAULT_FRAME_COUNT << ")" << endl
+			<< "[output] - path of the JSON result file (default " << DEFAULT_OUTPUT_FILE << ")" << endl;
+		return 1;
+	}
+
+	int frames = argc > 1 ? atoi(argv[1]) : DEFAULT_FRAME_COUNT;
+	if (frames < 1)
+	{
+		cout << "The number of measured frames has to be positive" << endl;
+		return 1;
+	}
+	string outputPath = argc > 2 ? argv[2] : DEFAULT_OUTPUT_FILE;
+
+	WSADATA wsaData;
+	if (WSAStartup(MAKEWORD(2, 2), &wsaData) != 0)
+	{
+		cout << "WSAStartup failed" << endl;
+		return 1;
+	}
+
+	Networking::PooledMatAllocator pooledAllocator; // outlives the counting allocator - the pool frees what it allocated
+	CountingMatAllocator countingAllocator;
+	cv::Mat::setDefaultAllocator(&countingAllocator);
+
+	CreateDirectoryA("../Data", NULL);
+	CreateDirectoryA(RECORDING_DIRECTORY, NULL);
+
+	vector<BenchmarkResult> results;
+	Networking::ChannelType channelTypes[] = { Networking::ChannelType::Color, Networking::ChannelType::Depth, Networking::ChannelType::Ir };
+
+	for (auto type : channelTypes)
+	{
+		string channelName = ChannelName(type);
+		Networking::ChannelProperties channelProperties(type);
+		Networking::NetworkPacket packet = SyntheticPacket(channelProperties);
+		cout << channelProperties.ToString() << ", " << packet.Data.size() << " bytes per compressed frame" << endl;
+
+		results.push_back(BenchmarkReceivePacket(type, frames));
+
+		Networking::NetworkPacketProcessor packetProcessor(&channelProperties);
+		results.push_back(Measure("ProcessPacket/" + channelName, frames, [&](size_t) { packetProcessor.ProcessPacket(packet); return packet.Data.size(); }));
+
+		countingAllocator.UsePool(&pooledAllocator);
+		results.push_back(Measure("ProcessPacketPooled/" + channelName, frames, [&](size_t) { packetProcessor.ProcessPacket(packet); return packet.Data.size(); }));
+		countingAllocator.UsePool(NULL);
+
+		Recording::FrameRecorder frameRecorder(RECORDING_DIRECTORY, &channelProperties, 0, BENCHMARK_CAMERA_INDEX); // a recording cycle of 0 records every frame
+		cv::Mat frame = packetProcessor.ProcessPacket(packet).clone();
+		results.push_back(Measure("RecordFrame/" + channelName, RECORDING_FRAME_COUNT, [&](size_t frameIndex) { frameRecorder.RecordFrame(frame, (unsigned int)frameIndex + 1); return packet.Data.size(); }));
+	}
+
+#ifdef KINECT_CLIENT_WITH_FFMPEG
+	// video streams are only decoded here - they are received like any other stream, and recorded as decoded frames
+	Networking::ChannelType videoChannelTypes[] = { Networking::ChannelType::ColorH264, Networking::ChannelType::ColorHevc };
+
+	for (auto type : videoChannelTypes)
+	{
+		string channelName = ChannelName(type);
+		Networking::ChannelProperties channelProperties(type);
+		vector<Networking::NetworkPacket> packets = SyntheticVideoPackets(channelProperties);
+		size_t sequenceBytes = 0;
+		for (auto& packet : packets) sequenceBytes += packet.Data.size();
+		cout << channelProperties.ToString() << ", " << sequenceBytes / packets.size() << " bytes per compressed frame (keyframe " << packets[0].Data.size() << ")" << endl;
+
+		// every packet in turn, as the decoder needs them - each run starts over at the keyframe
+		Networking::NetworkPacketProcessor packetProcessor(&channelProperties);
+		results.push_back(Measure("ProcessPacket/" + channelName, frames, [&](size_t frameIndex) { auto& packet = packets[frameIndex % packets.size()]; packetProcessor.ProcessPacket(packet); return packet.Data.size(); }));
+
+		countingAllocator.UsePool(&pooledAllocator);
+		results.push_back(Measure("ProcessPacketPooled/" + channelName, frames, [&](size_t frameIndex) { auto& packet = packets[frameIndex % packets.size()]; packetProcessor.ProcessPacket(packet); return packet.Data.size(); }));
+		countingAllocator.UsePool(NULL);
+	}
+#endif
+
+	ofstream outputFile(outputPath.c_str());
+#ifdef _DEBUG
+	outputFile << "{" << endl << "  \"configuration\": \"Debug\"," << endl;
+#else
+	outputFile << "{" << endl << "  \"configuration\": \"Release\"," << endl;
+#endif
+	outputFile << "  \"results\": [" << endl;
+	for (size_t i = 0; i < results.size(); i++)
+		outputFile << results[i].ToJson() << (i + 1 < results.size() ? "," : "") << endl;
+	outputFile << "  ]" << endl << "}" << endl;
+	cout << "Results written to " << outputPath << endl;
+	cout << "Pooled frame buffers: " << pooledAllocator.ToString() << endl;
+
+	cv::Mat::setDefaultAllocator(NULL);
+	WSACleanup();
+
+	return 0;
+}
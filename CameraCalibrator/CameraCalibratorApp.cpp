@@ -26,6 +26,7 @@ typedef std::vector<cv::Point3f> ObjectSpacePoints;
 
 const std::string PathToCalibrationFiles("../Data/CalibrationFiles");
 const std::string OutputFileName("../Data/CalibrationResult.txt");
+const std::string OutputCalibrationFileName("../Data/CalibrationResult.xml"); // read by the client's undistortion stage (UndistortionStage::Load)
 
 // another piece of bad code - the intrinsics should be obtained and saved by the client
 cv::Mat firstCamCalibration = (cv::Mat_<float>(3, 3) << 365.52, 0, 256.919, 0, 365.52, 207.111, 0, 0, 1);
@@ -117,6 +118,16 @@ int main()
 	outputFile << "Translation: " << cv::format(T, cv::Formatter::FMT_MATLAB) << std::endl;
 	outputFile << "Rotation: " << cv::format(R, cv::Formatter::FMT_MATLAB) << std::endl;
 
+	cv::FileStorage calibrationFile(OutputCalibrationFileName, cv::FileStorage::WRITE);
+	calibrationFile << "ImageWidth" << imageSize.width << "ImageHeight" << imageSize.height;
+	for (int camera = 0; camera < NUMBER_OF_CAMERAS; camera++)
+	{
+		calibrationFile << "CameraMatrix_" + std::to_string(camera) << cameraMatrix[camera];
+		calibrationFile << "DistortionCoefficients_" + std::to_string(camera) << distortionCoeffs[camera];
+	}
+	calibrationFile << "Rotation" << R << "Translation" << T; // of the second camera relative to the first
+	calibrationFile.release();
+
 	#pragma endregion
 
 	#pragma region print results
@@ -0,0 +1,474 @@
+// A loopback proxy between the client and the servers (the Jetson boards, or a ReplayServer) that degrades the streams the way a congested
+// network would: added latency, jitter, a bandwidth cap and stalls, each camera's connection on its own, following a scripted profile.
+// The profile and its random seed make a run repeatable, so the receive path and the synchronizer can be benchmarked under the same bad
+// conditions again and again. The client connects to it like to any single host serving all the cameras (-host localhost).
+
+#include "Networking\ClockModel.h" // first - brings in winsock2.h, which must come before windows.h
+#include "Networking\ControlMessage.h"
+#include <ws2tcpip.h> // getaddrinfo
+#include <opencv2\core\core.hpp> // FileStorage, for the profile
+#include <iostream>
+#include <string>
+#include <vector>
+#include <deque>
+#include <random>
+#include <algorithm>
+#include <math.h>
+
+#include <windows.h>  // multithreading
+#include <process.h>  // multithreading
+
+using namespace std;
+using namespace cv;
+
+#define PORT 3490 // the proxy serves camera i on PORT + i (the client connects this way when given -host)
+#define SERVER_NAME_HEADER "JetsonBoard" // by default camera i is fetched from JetsonBoard(i+1).local:PORT, like the client would
+#define SERVER_NAME_TAIL   ".local"
+#define MAX_NUMBER_OF_CAMERAS 4
+#define MAX_QUEUED_BYTES (64 << 20) // per camera; beyond that the proxy stops reading, and TCP pushes back on the server
+#define CHUNK_SIZE (16 << 10) // [bytes], packets leave in chunks of this size, so that the bandwidth cap paces them smoothly
+#define STATISTICS_PERIOD 5000 // [ms]
+
+#pragma region Globals
+
+// one step of a profile - the conditions hold for Duration, then the next phase starts (and after the last, the first again)
+struct ImpairmentPhase
+{
+	double Duration; // [s]
+	double Latency; // [ms], added to every packet
+	double Jitter; // [ms], standard deviation of a normally distributed extra delay (packets still leave in order, as on a TCP connection)
+	double Bandwidth; // [Mbit/s], 0 - unlimited
+	double StallInterval; // [s], mean time between stalls (exponentially distributed), 0 - no stalls
+	double StallDuration; // [ms], nothing leaves during a stall, and whatever piled up leaves in a burst after it
+};
+
+struct ImpairedPacket
+{
+	vector<char> Bytes; // header and payload, as they came from the server
+	double ArrivalTime; // [ms]
+	double ReleaseTime; // [ms], arrival plus latency and jitter
+};
+
+struct ProxyStream
+{
+	unsigned int CameraIndex;
+	string ServerName, ServerPort;
+	vector<ImpairmentPhase> Profile;
+	double ProfileDuration; // [ms], of one pass through the phases
+
+	// per connection - the profile and the random generators start over with every client, so every run sees the same conditions
+	SOCKET ClientConnection, ServerConnection;
+	volatile bool Connected;
+	double ConnectionTime; // [ms]
+	mt19937 JitterRandom, StallRandom;
+	deque<ImpairedPacket> Queue; // guarded by Lock
+	size_t QueuedBytes; // guarded by Lock
+	double LastReleaseTime; // [ms]
+	CRITICAL_SECTION Lock;
+	HANDLE PacketQueued; // auto-reset event
+
+	// per connection statistics
+	unsigned int Packets, Stalls;
+	double Bytes, TotalDelay, MaximalDelay; // [ms] for the delays
+};
+
+ProxyStream Streams[MAX_NUMBER_OF_CAMERAS];
+unsigned int Seed = 0;
+
+#pragma endregion
+
+unsigned __stdcall ProxyThreadFunction(void* stream); // implemented below
+vector<ImpairmentPhase> LoadPhases(const FileNode& node); // implemented below
+
+int main(int argc, char** argv)
+{
+#pragma region process input arguments
+
+	if (argc < 3)
+	{
+		cout << "usage: " << argv[0] << " n profile [-upstream host port]" << endl
+			<< "n - a mandatory parameter, specifies the number of cameras to proxy" << endl
+			<< "profile - a mandatory path to the impairment profile, a YAML file (see CongestedWiFi.yml) with a Seed and a list of Phases, each with" << endl
+			<< "  Duration [s], Latency [ms], Jitter [ms], Bandwidth [Mbit/s], StallInterval [s] and StallDuration [ms] (missing ones are 0 - no impairment)." << endl
+			<< "  A list named Camera_i replaces the Phases for camera i. The phases repeat, and start over with every client" << endl
+			<< "[-upstream host port] - an optional host serving all the cameras, camera i on port + i, e.g. a ReplayServer started with -port" << endl
+			<< "  (default - the Jetson boards). The client connects to the proxy with -host, camera i on port " << PORT << " + i" << endl;
+		return 1;
+	}
+
+	unsigned int cameraCount = atoi(argv[1]);
+	if (cameraCount > MAX_NUMBER_OF_CAMERAS) throw runtime_error("Currently only supporting up to " + std::to_string(MAX_NUMBER_OF_CAMERAS) + " cameras.");
+	string upstreamHost;
+	int upstreamPort = PORT;
+
+	for (int argIndex = 3; argIndex < argc; argIndex++)
+	{
+		if (_strcmpi(argv[argIndex], "-upstream") == 0 && argIndex + 2 < argc)
+		{
+			upstreamHost = argv[++argIndex];
+			upstreamPort = atoi(argv[++argIndex]);
+		}
+	}
+
+#pragma endregion
+
+#pragma region load profile
+
+	FileStorage profile(argv[2], FileStorage::READ);
+	if (!profile.isOpened()) throw runtime_error(string("Could not open the profile ") + argv[2]);
+	Seed = (int)profile["Seed"];
+
+	for (unsigned int i = 0; i < cameraCount; i++)
+	{
+		ProxyStream& stream = Streams[i];
+		stream.CameraIndex = i;
+		if (upstreamHost.empty())
+		{
+			stream.ServerName = string(SERVER_NAME_HEADER) + to_string(i + 1) + string(SERVER_NAME_TAIL);
+			stream.ServerPort = to_string(PORT);
+		}
+		else
+		{
+			stream.ServerName = upstreamHost;
+			stream.ServerPort = to_string(upstreamPort + i);
+		}
+
+		FileNode phases = profile["Camera_" + to_string(i)];
+		stream.Profile = LoadPhases(phases.empty() ? profile["Phases"] : phases);
+		if (stream.Profile.empty()) throw runtime_error("The profile has no phases for camera " + to_string(i));
+		stream.ProfileDuration = 0;
+		for (auto& phase : stream.Profile) stream.ProfileDuration += 1000 * phase.Duration;
+
+		cout << "Camera " << i << ": " << stream.ServerName << ":" << stream.ServerPort << " served on port " << PORT + i << ", "
+			<< stream.Profile.size() << " phase(s) repeating every " << stream.ProfileDuration / 1000 << " [s]" << endl;
+	}
+
+#pragma endregion
+
+#pragma region launch threads
+
+	WSADATA wsaData;
+	if (WSAStartup(MAKEWORD(2, 2), &wsaData) != 0)
+	{
+		cout << "WSAStartup failed" << endl;
+		return 1;
+	}
+	timeBeginPeriod(1); // Sleep in steps of a millisecond rather than of the default ~15, or the added delays are that coarse
+
+	vector<HANDLE> handlesToThreads;
+	for (unsigned int i = 0; i < cameraCount; i++)
+	{
+		InitializeCriticalSection(&Streams[i].Lock);
+		Streams[i].PacketQueued = CreateEvent(NULL, FALSE, FALSE, NULL);
+		handlesToThreads.push_back((HANDLE)_beginthreadex(NULL, 0, &ProxyThreadFunction, &Streams[i], 0, NULL));
+	}
+
+	WaitForMultipleObjects((DWORD)handlesToThreads.size(), &handlesToThreads[0], TRUE, INFINITE);
+	timeEndPeriod(1);
+	WSACleanup();
+
+#pragma endregion
+
+	return 0;
+}
+
+vector<ImpairmentPhase> LoadPhases(const FileNode& node)
+{
+	vector<ImpairmentPhase> phases;
+	for (FileNodeIterator it = node.begin(); it != node.end(); ++it)
+	{
+		ImpairmentPhase phase;
+		phase.Duration = (double)(*it)["Duration"];
+		phase.Latency = (double)(*it)["Latency"];
+		phase.Jitter = (double)(*it)["Jitter"];
+		phase.Bandwidth = (double)(*it)["Bandwidth"];
+		phase.StallInterval = (double)(*it)["StallInterval"];
+		phase.StallDuration = (double)(*it)["StallDuration"];
+		if (phase.Duration <= 0) throw runtime_error("Every phase of the profile needs a positive Duration");
+		phases.push_back(phase);
+	}
+
+	return phases;
+}
+
+#pragma region impairment
+
+// the phase in force at the given time; the profile runs from the moment the client connected
+int CurrentPhase(const ProxyStream* stream, double time)
+{
+	double profileTime = fmod(time - stream->ConnectionTime, stream->ProfileDuration);
+	int phaseIndex = 0;
+	while (phaseIndex + 1 < (int)stream->Profile.size() && profileTime >= 1000 * stream->Profile[phaseIndex].Duration)
+		profileTime -= 1000 * stream->Profile[phaseIndex++].Duration;
+
+	return phaseIndex;
+}
+
+// sleeps until the given time with millisecond precision (see timeBeginPeriod), or until the connection is gone
+void WaitUntil(const ProxyStream* stream, double time)
+{
+	for (double now = Networking::ClockModel::Now(); now < time && stream->Connected; now = Networking::ClockModel::Now())
+		Sleep(time - now > 2 ? (DWORD)(time - now - 1) : 0);
+}
+
+// ends the connection on both sides, which also wakes up whichever thread is blocked on one of the sockets
+void Disconnect(ProxyStream* stream)
+{
+	stream->Connected = false;
+	shutdown(stream->ClientConnection, SD_BOTH);
+	shutdown(stream->ServerConnection, SD_BOTH);
+	SetEvent(stream->PacketQueued);
+}
+
+#pragma endregion
+
+#pragma region forwarding
+
+bool SendAll(SOCKET connection, const char* buffer, int length)
+{
+	for (int sent = 0; sent < length; )
+	{
+		int result = send(connection, buffer + sent, length - sent, 0);
+		if (result == SOCKET_ERROR) return false;
+		sent += result;
+	}
+
+	return true;
+}
+
+bool ReceiveAll(SOCKET connection, char* buffer, int length)
+{
+	for (int received = 0; received < length; )
+	{
+		int result = recv(connection, buffer + received, length - received, 0);
+		if (result <= 0) return false;
+		received += result;
+	}
+
+	return true;
+}
+
+SOCKET ConnectToServer(const ProxyStream* stream)
+{
+	struct addrinfo hints = { 0 }, *serverAddress = NULL;
+	hints.ai_family = AF_UNSPEC;
+	hints.ai_socktype = SOCK_STREAM;
+	hints.ai_protocol = IPPROTO_TCP;
+	if (getaddrinfo(stream->ServerName.c_str(), stream->ServerPort.c_str(), &hints, &serverAddress) != 0) return INVALID_SOCKET;
+
+	SOCKET connection = INVALID_SOCKET;
+	for (struct addrinfo* ptr = serverAddress; ptr != NULL && connection == INVALID_SOCKET; ptr = ptr->ai_next)
+	{
+		connection = socket(ptr->ai_family, ptr->ai_socktype, ptr->ai_protocol);
+		if (connection != INVALID_SOCKET && connect(connection, ptr->ai_addr, (int)ptr->ai_addrlen) == SOCKET_ERROR)
+		{
+			closesocket(connection);
+			connection = INVALID_SOCKET;
+		}
+	}
+
+	freeaddrinfo(serverAddress);
+	return connection;
+}
+
+// server -> queue: reads whole packets and stamps each with the time it may leave (latency and jitter); stalls and the bandwidth cap
+// are applied as the packets leave (see ForwardPackets), as that's where a congested link holds them up
+unsigned __stdcall ReceivePacketsThreadFunction(void* proxyStream)
+{
+	ProxyStream* stream = (ProxyStream*)proxyStream;
+	const int bytesInHeader = 11; // 4 byte seconds, 4 byte milliseconds, 3 byte payload size
+	normal_distribution<double> normal;
+
+	while (stream->Connected)
+	{
+		ImpairedPacket packet;
+		packet.Bytes.resize(bytesInHeader);
+		if (!ReceiveAll(stream->ServerConnection, &packet.Bytes[0], bytesInHeader)) break;
+		const unsigned char* size = (const unsigned char*)&packet.Bytes[8];
+		int payloadSize = size[0] | (size[1] << 8) | (size[2] << 16);
+		packet.Bytes.resize(bytesInHeader + payloadSize);
+		if (payloadSize > 0 && !ReceiveAll(stream->ServerConnection, &packet.Bytes[bytesInHeader], payloadSize)) break;
+
+		packet.ArrivalTime = Networking::ClockModel::Now();
+		const ImpairmentPhase& phase = stream->Profile[CurrentPhase(stream, packet.ArrivalTime)];
+		double delay = max(0., phase.Latency + phase.Jitter * normal(stream->JitterRandom));
+		packet.ReleaseTime = max(packet.ArrivalTime + delay, stream->LastReleaseTime); // a late packet holds up the ones behind it
+		stream->LastReleaseTime = packet.ReleaseTime;
+
+		EnterCriticalSection(&stream->Lock);
+		stream->QueuedBytes += packet.Bytes.size();
+		stream->Queue.push_back(move(packet));
+		size_t queuedBytes = stream->QueuedBytes;
+		LeaveCriticalSection(&stream->Lock);
+		SetEvent(stream->PacketQueued);
+
+		while (queuedBytes > MAX_QUEUED_BYTES && stream->Connected) // stop reading - the server's sends block, like behind a real bottleneck
+		{
+			Sleep(1);
+			EnterCriticalSection(&stream->Lock);
+			queuedBytes = stream->QueuedBytes;
+			LeaveCriticalSection(&stream->Lock);
+		}
+	}
+
+	Disconnect(stream);
+	return 0;
+}
+
+// client -> server: control messages pass unimpaired - they are few and small, and the downstream is what's being tested
+unsigned __stdcall ForwardControlMessagesThreadFunction(void* proxyStream)
+{
+	ProxyStream* stream = (ProxyStream*)proxyStream;
+	char buffer[Networking::BytesInControlMessage];
+
+	while (stream->Connected)
+	{
+		int received = recv(stream->ClientConnection, buffer, sizeof(buffer), 0);
+		if (received <= 0 || !SendAll(stream->ServerConnection, buffer, received)) break;
+	}
+
+	Disconnect(stream);
+	return 0;
+}
+
+void PrintStatistics(ProxyStream* stream, int phaseIndex)
+{
+	EnterCriticalSection(&stream->Lock);
+	size_t queuedBytes = stream->QueuedBytes;
+	LeaveCriticalSection(&stream->Lock);
+
+	printf("Camera %d: phase %d, forwarded %d packets (%.1f [MB]), added delay %.1f [ms] on average, %.1f [ms] at most, %d stalls, %.1f [MB] queued\n",
+		stream->CameraIndex, phaseIndex, stream->Packets, stream->Bytes / (1 << 20), stream->Packets > 0 ? stream->TotalDelay / stream->Packets : 0.,
+		stream->MaximalDelay, stream->Stalls, (double)queuedBytes / (1 << 20));
+}
+
+// queue -> client: sends every packet once it's due, paced by the bandwidth cap, and holds everything back during a stall
+void ForwardPackets(ProxyStream* stream)
+{
+	exponential_distribution<double> exponential;
+	double linkFreeTime = 0; // [ms], when the last chunk has left at the capped bandwidth
+	double nextStallTime = -1; // [ms], -1 - none scheduled
+	double nextStatisticsTime = stream->ConnectionTime + STATISTICS_PERIOD;
+	int lastPhaseIndex = -1;
+
+	while (stream->Connected)
+	{
+		double now = Networking::ClockModel::Now();
+		int phaseIndex = CurrentPhase(stream, now);
+		const ImpairmentPhase& phase = stream->Profile[phaseIndex];
+		if (phaseIndex != lastPhaseIndex)
+		{
+			printf("Camera %d: phase %d - latency %.0f [ms], jitter %.0f [ms], bandwidth %.1f [Mbit/s], a %.0f [ms] stall every %.1f [s]\n",
+				stream->CameraIndex, phaseIndex, phase.Latency, phase.Jitter, phase.Bandwidth, phase.StallDuration, phase.StallInterval);
+			lastPhaseIndex = phaseIndex;
+			nextStallTime = phase.StallInterval > 0 ? now + 1000 * phase.StallInterval * exponential(stream->StallRandom) : -1;
+		}
+		if (now >= nextStatisticsTime)
+		{
+			PrintStatistics(stream, phaseIndex);
+			nextStatisticsTime += STATISTICS_PERIOD;
+		}
+
+		EnterCriticalSection(&stream->Lock);
+		ImpairedPacket* packet = stream->Queue.empty() ? NULL : &stream->Queue.front(); // only this thread pops, so it stays valid
+		LeaveCriticalSection(&stream->Lock);
+		if (!packet)
+		{
+			WaitForSingleObject(stream->PacketQueued, 100);
+			continue;
+		}
+
+		WaitUntil(stream, packet->ReleaseTime);
+
+		for (size_t sent = 0; sent < packet->Bytes.size() && stream->Connected; )
+		{
+			if (nextStallTime >= 0 && Networking::ClockModel::Now() >= nextStallTime)
+			{
+				WaitUntil(stream, nextStallTime + phase.StallDuration);
+				stream->Stalls++;
+				nextStallTime = Networking::ClockModel::Now() + 1000 * phase.StallInterval * exponential(stream->StallRandom);
+			}
+
+			WaitUntil(stream, linkFreeTime);
+			int chunkSize = (int)min(packet->Bytes.size() - sent, (size_t)CHUNK_SIZE);
+			if (!SendAll(stream->ClientConnection, &packet->Bytes[sent], chunkSize)) Disconnect(stream);
+			sent += chunkSize;
+			if (phase.Bandwidth > 0) linkFreeTime = max(linkFreeTime, Networking::ClockModel::Now()) + chunkSize * 8 / (1000 * phase.Bandwidth);
+		}
+
+		double delay = Networking::ClockModel::Now() - packet->ArrivalTime;
+		stream->Packets++;
+		stream->Bytes += packet->Bytes.size();
+		stream->TotalDelay += delay;
+		stream->MaximalDelay = max(stream->MaximalDelay, delay);
+
+		EnterCriticalSection(&stream->Lock);
+		stream->QueuedBytes -= stream->Queue.front().Bytes.size();
+		stream->Queue.pop_front();
+		LeaveCriticalSection(&stream->Lock);
+	}
+
+	PrintStatistics(stream, lastPhaseIndex);
+}
+
+unsigned __stdcall ProxyThreadFunction(void* proxyStream)
+{
+	ProxyStream* stream = (ProxyStream*)proxyStream;
+
+	SOCKET listeningSocket = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+	sockaddr_in address = { 0 };
+	address.sin_family = AF_INET;
+	address.sin_addr.s_addr = htonl(INADDR_ANY);
+	address.sin_port = htons(PORT + stream->CameraIndex);
+	if (bind(listeningSocket, (sockaddr*)&address, sizeof(address)) == SOCKET_ERROR || listen(listeningSocket, 1) == SOCKET_ERROR)
+	{
+		printf("Camera %d: failed to listen on port %d: %d\n", stream->CameraIndex, PORT + stream->CameraIndex, WSAGetLastError());
+		return 1;
+	}
+
+	while (true) // proxy one client at a time, and wait for the next one when it leaves
+	{
+		printf("Camera %d: waiting for a client on port %d\n", stream->CameraIndex, PORT + stream->CameraIndex);
+		stream->ClientConnection = accept(listeningSocket, NULL, NULL);
+		if (stream->ClientConnection == INVALID_SOCKET) continue;
+
+		// the metadata byte passes straight through - the client waits for it before anything else
+		char metadata;
+		stream->ServerConnection = ConnectToServer(stream);
+		if (stream->ServerConnection == INVALID_SOCKET || !ReceiveAll(stream->ServerConnection, &metadata, 1) || !SendAll(stream->ClientConnection, &metadata, 1))
+		{
+			printf("Camera %d: could not get the stream from %s:%s\n", stream->CameraIndex, stream->ServerName.c_str(), stream->ServerPort.c_str());
+			if (stream->ServerConnection != INVALID_SOCKET) closesocket(stream->ServerConnection);
+			closesocket(stream->ClientConnection); // the client retries with backoff
+			continue;
+		}
+
+		int noDelay = 1; // chunks leave when the profile says so, not when Nagle's algorithm does
+		setsockopt(stream->ClientConnection, IPPROTO_TCP, TCP_NODELAY, (char*)&noDelay, sizeof(noDelay));
+
+		stream->Connected = true;
+		stream->ConnectionTime = Networking::ClockModel::Now();
+		stream->JitterRandom.seed(Seed + 2 * stream->CameraIndex);
+		stream->StallRandom.seed(Seed + 2 * stream->CameraIndex + 1);
+		stream->Queue.clear();
+		stream->QueuedBytes = 0;
+		stream->LastReleaseTime = 0;
+		stream->Packets = stream->Stalls = 0;
+		stream->Bytes = stream->TotalDelay = stream->MaximalDelay = 0;
+		printf("Camera %d: client connected, proxying %s:%s\n", stream->CameraIndex, stream->ServerName.c_str(), stream->ServerPort.c_str());
+
+		HANDLE threads[2];
+		threads[0] = (HANDLE)_beginthreadex(NULL, 0, &ReceivePacketsThreadFunction, stream, 0, NULL);
+		threads[1] = (HANDLE)_beginthreadex(NULL, 0, &ForwardControlMessagesThreadFunction, stream, 0, NULL);
+		ForwardPackets(stream);
+		WaitForMultipleObjects(2, threads, TRUE, INFINITE);
+		CloseHandle(threads[0]);
+		CloseHandle(threads[1]);
+
+		printf("Camera %d: client disconnected\n", stream->CameraIndex);
+		closesocket(stream->ServerConnection);
+		closesocket(stream->ClientConnection);
+	}
+}
+
+#pragma endregion
@@ -1,68 +1,173 @@
 #include <opencv2\highgui\highgui.hpp>
+#include <opencv2\imgproc\imgproc.hpp>
 #include <iostream>
 
 #include "Networking\PacketClient.h" // networking class
 #include "Networking\NetworkPacketProcessor.h"
+#include "Networking\LazyFrame.h"
 #include "Networking\Timer.h"  // telemetry class
+#include "Networking\ThreadBarrier.h"
+#include "Networking\ThreadPlacement.h"
+#include "Networking\QualityController.h"
+#include "Networking\FrameBusPublisher.h"
+#include "Networking\ChangeDetector.h"
+#include "Networking\ClockModel.h"
+#include "Networking\PooledMatAllocator.h"
+#include "Networking\DepthBackgroundModel.h"
+#include "Networking\UndistortionStage.h"
+#include "Networking\TsdfVolume.h"
+#include "Networking\RelayServer.h"
 
 #include "Recording\FrameRecorder.h"
 #include "Recording\CalibrationPatternRecorder.h"
+#include "Recording\FlightRecorder.h"
 
 #include <windows.h>  // multithreading
 #include <process.h>  // multithreading
+#include <conio.h> // keys pressed in the console
 #include <memory>
 #include <math.h>
+#include <climits>
 // don't forget to pick the correct multithreading runtime library in the Visual Studio project properties in order to get this code to compile
 
 using namespace std;
 using namespace cv;
 
-#define PORT "3490" // randomly chosen (must agree with the servers' port)
+#define PORT "3490" // randomly chosen (must agree with the servers' port). When all cameras are served by a single host (-host), camera i is on PORT + i (or on -port + i)
+#define RELAY_PORT 3500 // with -relay, camera i is re-served to subscribers on RELAY_PORT + i
 #define SERVER_NAME_HEADER "JetsonBoard" // JetsonBoardi.local where i stands for the index of the board (written with red Sharpie on the board itself)
 #define SERVER_NAME_TAIL   ".local"
 
 #define RECORDING_DIRECTORY "../Data" // path to the directory where the recordings from different Kinects will be stored (relative to solution .sln file)
 #define FRAMES_BETWEEN_SHOTS 80 // frames to wait until the consecutive frame should be saved
+#define FLIGHT_RECORDER_BUDGET 1024 // [MB] of packets the flight recorder (-flight) may hold, shared equally by the cameras
+#define FLIGHT_RECORDER_KEY 'f' // dumps the flight recorder (so does Ctrl+Break)
+#define CALIBRATION_RESULT_FILE RECORDING_DIRECTORY "/CalibrationResult.xml" // as written by CameraCalibrator, for -undistort, -rectify and -tsdf
+#define TSDF_VOXEL_SIZE 10.f // [mm], of the reconstruction (-tsdf)
+#define TSDF_TRUNCATION 40.f // [mm], a few voxels - Kinect v2 depth noise is a few mm, growing with distance
+#define TSDF_MAXIMAL_BLOCKS 131072 // of 8x8x8 voxels, ~4 KB each - ~540 [MB], a room at TSDF_VOXEL_SIZE several times over
+#define TSDF_EVICTION_AGE 900 // [integrations] without a touch before a block may be evicted to make room - ~15 [s] of two cameras at 30 fps
+#define RECONSTRUCTION_KEY 'p' // saves the surface of the reconstruction as a point cloud
+
+#define DISPLAY_REFRESH_PERIOD 10 // [ms] between checks for a new frame to display (the display runs on the main thread)
 
 #define FRAMES_BETWEEN_TELEMETRY_MESSAGES 30 // every so many frames, the average FPS and BW will be printed to the command window
 
-#define THREAD_BARRIER_SPIN_COUNT -1 // the number of times a thread will attempt to check the barrier state (a.k.a. - spin) before it blocks (-1 corresponds to a system defalut value of 2k)
+#define QUALITY_STATISTICS_DECODE_PERIOD 30 // with -dq, a frame no consumer decoded is decoded anyway for the statistics if the last so many weren't
+
+#define RECONNECTION_DELAY_AFTER_BAD_METADATA 1000 // [ms] to wait before reconnecting to a server that sent unexpected metadata
 
-#define SYNCHRONIZATION_THRESHOLD 30 // frames with a time gap of less than or equal to SYNCHRONIZATION_THRESHOLD [ms] will be considered synchronized
+#define SYNCHRONIZATION_THRESHOLD 30 // frames with a time gap of less than or equal to SYNCHRONIZATION_THRESHOLD [ms] will be considered synchronized.
+                                    // The gap is measured on the client's clock (see ClockModel), so the offset between the boards' clocks no longer
+                                    // eats into it - but each camera's offset also absorbs its own capture-to-send delay (encoding, transmission),
+                                    // which differs between cameras; until that residual bias is measured, the margin stays what it was
 
 #define MAX_NUMBER_OF_CAMERAS 4
 
+#define KEYFRAME_REQUEST_PERIOD 1000 // [ms] between requests for a keyframe while a video stream's decoder waits for one
+
+#define LATEST_RECEIVE_BUFFER_SIZE (8 << 20) // [bytes] of socket receive buffer with -latest - a default one (~64 KB) can't hold even one 1080p JPEG,
+                                             // so a backlog would pile up on the server and stale frames would never be seen waiting; this holds
+                                             // a dozen or so color frames, or several raw depth ones
+
+#define TARGET_LATENCY 100 // [ms], the end-to-end latency the adaptive stream control (-adapt) tries to stay under
+
 #define CALIBRATION_PATTERN_WIDTH  6
 #define CALIBRATION_PATTERN_HEIGHT 9
 
+// the places in the main loop where the threads meet (a reconnecting thread may only rejoin at the receive barrier)
+enum BarrierSite
+{
+	ReceiveSite,
+	SynchronizeSite,
+	CalibrationSite
+};
+
 #pragma region Globals
 
-LPSYNCHRONIZATION_BARRIER barrier; // a GLOBAL barrier shared among all the threads
-bool FirstThreadFinished = false;// the first thread thread that finished its work raises this flag which consequently kills all the other threads
+Networking::PooledMatAllocator PooledAllocator; // recycles the per-frame temporaries; defined first, so it outlives every Mat below
+Networking::ThreadBarrier* barrier; // a GLOBAL barrier shared among all the connected threads
+volatile bool CameraActive[MAX_NUMBER_OF_CAMERAS] = { false }; // raised while a camera is connected and takes part in the synchronization
+volatile bool ShuttingDown = false; // raised on Ctrl+C, makes all the threads wrap up
 Networking::NetworkPacket Packets[MAX_NUMBER_OF_CAMERAS];
-bool DroppingFrame = false;
+double CaptureTimes[MAX_NUMBER_OF_CAMERAS]; // [ms], the packets' timestamps mapped onto the client's clock
+volatile unsigned long long DroppedFrameset = ULLONG_MAX; // the barrier generation (see ThreadBarrier::Enter) of the last frameset some camera found out of sync
 
 bool RecordImages = false; // a flag to signify whether the incoming stream neet to be recorded (once every FRAMES_BETWEEN_SHOTS)
 bool DisplayImages = false; // a flag to signify whether the incoming strems need to be displayed to screen
+bool LatestFrameOnly = false; // a flag to signify whether stale frames should be skipped in favour of the newest one (low latency preview)
+bool AdaptStream = false; // a flag to signify whether the client asks the servers to lower quality, frame rate or resolution when it falls behind
+bool PublishFrames = false; // a flag to signify whether the synchronized frames are published to other local processes over shared memory (see FrameBusSubscriber)
+bool PublishCompressed = false; // publish the packets as received (JPEG/PNG) instead of the decoded frames
+bool DetectChanges = false; // a flag to signify whether frames are checked against the previous ones, so that consumers can skip unchanged ones
+bool SkipUnchangedRecording = false; // which consumers skip unchanged frames (see -skip)
+bool SkipUnchangedCalibration = false;
+bool SkipUnchangedDisplay = false;
+bool SkipUnchangedPublishing = false;
+bool DetectForeground = false; // a flag to signify whether depth cameras keep a background model and report what stands in front of it
+double FlightRecorderWindow = 0; // [s] of packets kept in memory, to be dumped on demand; 0 - no flight recorder
+Recording::FlightRecorder* FlightRecording = NULL;
+bool RelayPackets = false; // a flag to signify whether the received packets are re-served to other clients (see RelayServer)
+bool ReconstructScene = false; // a flag to signify whether the depth cameras' synchronized frames are fused into one volume
+Networking::TsdfVolume* Reconstruction = NULL;
+unsigned int SavedReconstructions = 0;
+int JpegDecodeBands = 1; // how many cores decode a color frame the server made splittable (see ParallelJpegDecoder)
+int QualityStatisticsRowStride = 0; // every so many rows of the decoded depth and IR frames go into DepthQualityStatistics; 0 - none
+bool UndistortFrames = false; // a flag to signify whether the consumers get frames with the lens distortion removed
+bool RectifyFrames = false; // a flag to signify whether cameras 0 and 1 are also rectified as a stereo pair
+string ServerHost; // when not empty, all the cameras are served by this host (e.g. a ReplayServer) instead of by the Jetson boards
+int ServerBasePort = atoi(PORT); // with -host, camera i is served on ServerBasePort + i
 bool RecordCalibrationPattern = false; // a flag to signify whether the calibration pattern needs to be recorded (once every once every FRAMES_BETWEEN_SHOTS)
 bool PatternFound[MAX_NUMBER_OF_CAMERAS] = { false, false }; // two variables that indicate whether a calibration pattern was detected in the last frame
+bool PatternImproves[MAX_NUMBER_OF_CAMERAS] = { false, false }; // whether the detected pattern adds coverage or pose diversity to the calibration of that camera
 unsigned int cameraCount;
 
+Networking::ThreadPlacement Placement; // which cores the camera threads and the other threads run on
+bool UsePlacement = false;
+
+CRITICAL_SECTION DisplayLock; // guards the frame handed from the first camera thread to the main (display) thread
+Mat DisplayFrame;
+bool DisplayFrameReady = false;
+const Networking::ChannelProperties* DisplayChannelProperties = NULL;
+
 #pragma endregion
 
 unsigned __stdcall KinectClientThreadFunction(void* kinectIndex); // implemented below
+bool ConnectAndReceiveMetadata(Networking::PacketClient& client, const string& serverName, const string& port, const char* cameraNameString); // implemented below
+BOOL WINAPI ConsoleControlHandler(DWORD controlType); // implemented below
+void TriggerFlightRecorder(); // implemented below
+void SaveReconstruction(); // implemented below
+void ShowLatestFrame(const string& windowName); // implemented below
 
 int main(int argc, char** argv)
 {
 #pragma region process input arguments
 
-	if (argc > 4 || argc < 2)
+	if (argc < 2)
 	{
-		cout << "usage: " << argv[0] << " n [-r]" << endl
+		cout << "usage: " << argv[0] << " n [-ri] [-rc] [-di] [-latest] [-adapt] [-bus] [-busc] [-skip consumers] [-fg] [-split n] [-undistort] [-rectify] [-tsdf] [-relay] [-dq rows] [-flight seconds] [-host name] [-port base] [-placement file]" << endl
 			<< "n - a mandatory parameter, specifies the number of clients to launch" << endl
 			<< "[-ri] - an optinal flag that turns on image recording" << endl
 			<< "[-rc] - an optional flag that turns on calibration pattern recording" << endl
-			<< "[-di] - an optional flag do display the received image" << endl;
+			<< "[-di] - an optional flag do display the received image" << endl
+			<< "[-latest] - an optional flag that skips frames which already have a newer one waiting, trading completeness for latency" << endl
+			<< "[-adapt] - an optional flag that lets the client ask the servers for a lighter stream when it falls behind" << endl
+			<< "[-bus] - an optional flag that publishes the decoded frames to other local processes through shared memory" << endl
+			<< "[-busc] - like -bus, but publishes the compressed packets, for subscribers that decode only what they need" << endl
+			<< "[-skip consumers] - an optional list of consumers that skip unchanged frames (static scene): any of r (recording), c (calibration), d (display), b (frame bus)" << endl
+			<< "[-fg] - an optional flag that reports the objects in front of the background of each depth camera (outlined when displayed)" << endl
+			<< "[-split n] - an optional number of bands a color frame with restart markers (or sent in bands) is decoded as, in parallel" << endl
+			<< "[-undistort] - an optional flag that removes the lens distortion from the frames, as calibrated in " << CALIBRATION_RESULT_FILE << endl
+			<< "[-rectify] - like -undistort, and also rectifies cameras 1 and 2 as a stereo pair" << endl
+			<< "[-tsdf] - an optional flag that fuses the depth cameras' frames into a 3D reconstruction, saved as a point cloud when '" << (char)RECONSTRUCTION_KEY << "' is pressed" << endl
+			<< "[-relay] - an optional flag that re-serves the synchronized streams to any number of clients, camera i on port " << RELAY_PORT << " + i" << endl
+			<< "[-dq rows] - optional depth quality statistics (invalid pixels and ranges of depth, saturation of IR) over every so many rows of the decoded frames "
+			<< "(at least one in " << QUALITY_STATISTICS_DECODE_PERIOD << " is decoded for them), printed with the telemetry" << endl
+			<< "[-flight seconds] - an optional flight recorder, keeps that many seconds of all the streams in memory and dumps them to "
+			<< RECORDING_DIRECTORY << " when '" << (char)FLIGHT_RECORDER_KEY << "' or Ctrl+Break is pressed" << endl
+			<< "[-host name] - an optional host serving all the cameras (camera i on port " << PORT << " + i), e.g. a ReplayServer" << endl
+			<< "[-port base] - with -host, camera i is on port base + i instead, e.g. " << RELAY_PORT << " for another client's relay" << endl
+			<< "[-placement file] - an optional thread placement file, pins every camera thread to its own cores (see ThreadPlacement.h)" << endl;
 		return 1;
 	}
 
@@ -74,22 +179,76 @@ int main(int argc, char** argv)
 		RecordImages = RecordImages || _strcmpi(argv[argIndex], "-ri") == 0;
 		DisplayImages = DisplayImages || _strcmpi(argv[argIndex], "-di") == 0;
 		RecordCalibrationPattern = RecordCalibrationPattern || _strcmpi(argv[argIndex], "-rc") == 0;
+		AdaptStream = AdaptStream || _strcmpi(argv[argIndex], "-adapt") == 0;
+		LatestFrameOnly = LatestFrameOnly || _strcmpi(argv[argIndex], "-latest") == 0;
+		DetectForeground = DetectForeground || _strcmpi(argv[argIndex], "-fg") == 0;
+		RectifyFrames = RectifyFrames || _strcmpi(argv[argIndex], "-rectify") == 0;
+		ReconstructScene = ReconstructScene || _strcmpi(argv[argIndex], "-tsdf") == 0;
+		RelayPackets = RelayPackets || _strcmpi(argv[argIndex], "-relay") == 0;
+		UndistortFrames = UndistortFrames || RectifyFrames || _strcmpi(argv[argIndex], "-undistort") == 0;
+		PublishCompressed = PublishCompressed || _strcmpi(argv[argIndex], "-busc") == 0;
+		PublishFrames = PublishFrames || PublishCompressed || _strcmpi(argv[argIndex], "-bus") == 0;
+
+		if (_strcmpi(argv[argIndex], "-skip") == 0 && argIndex + 1 < argc)
+		{
+			string consumers = argv[++argIndex];
+			SkipUnchangedRecording = consumers.find('r') != string::npos;
+			SkipUnchangedCalibration = consumers.find('c') != string::npos;
+			SkipUnchangedDisplay = consumers.find('d') != string::npos;
+			SkipUnchangedPublishing = consumers.find('b') != string::npos;
+			DetectChanges = true;
+		}
+
+		if (_strcmpi(argv[argIndex], "-split") == 0 && argIndex + 1 < argc)
+			JpegDecodeBands = atoi(argv[++argIndex]); // 1 or less - one core
+
+		if (_strcmpi(argv[argIndex], "-dq") == 0 && argIndex + 1 < argc)
+		{
+			QualityStatisticsRowStride = atoi(argv[++argIndex]);
+			if (QualityStatisticsRowStride < 1) throw runtime_error("The row stride of the depth quality statistics (-dq) has to be positive");
+		}
+
+		if (_strcmpi(argv[argIndex], "-flight") == 0 && argIndex + 1 < argc)
+			FlightRecorderWindow = atof(argv[++argIndex]);
+
+		if (_strcmpi(argv[argIndex], "-host") == 0 && argIndex + 1 < argc)
+			ServerHost = argv[++argIndex];
+
+		if (_strcmpi(argv[argIndex], "-port") == 0 && argIndex + 1 < argc)
+			ServerBasePort = atoi(argv[++argIndex]);
+
+		if (_strcmpi(argv[argIndex], "-placement") == 0 && argIndex + 1 < argc)
+		{
+			Placement = Networking::ThreadPlacement::Load(argv[++argIndex]);
+			UsePlacement = true;
+		}
+	}
+
+	if (UsePlacement)
+	{
+		Placement.Activate();
+		Networking::ThreadPlacement::PinGeneralThread(); // the main thread runs the display
 	}
+	cout << "Main thread placement: " << Networking::ThreadPlacement::DescribeCurrentThread() << endl;
 
 	CreateDirectoryA(RECORDING_DIRECTORY, NULL);	
 
+	cv::Mat::setDefaultAllocator(&PooledAllocator); // before any thread allocates a Mat
+
+	if (FlightRecorderWindow > 0)
+		FlightRecording = new Recording::FlightRecorder(RECORDING_DIRECTORY, cameraCount, 1000 * FlightRecorderWindow, (size_t)FLIGHT_RECORDER_BUDGET << 20);
+
+	if (ReconstructScene) Reconstruction = new Networking::TsdfVolume(TSDF_VOXEL_SIZE, TSDF_TRUNCATION, TSDF_MAXIMAL_BLOCKS, TSDF_EVICTION_AGE);
+
 #pragma endregion
 
 #pragma region initialize synchronziation barrier	
 
-	barrier = (LPSYNCHRONIZATION_BARRIER)malloc(sizeof(SYNCHRONIZATION_BARRIER));
-	BOOL result = InitializeSynchronizationBarrier(barrier, cameraCount, -1);
+	barrier = new Networking::ThreadBarrier(); // threads join it as they connect to their servers, and leave it while reconnecting
 
-	if (result != TRUE)
-	{
-		cout << "Failed to initalize thread barrier" << endl << "last error: " << GetLastError() << endl;
-		return 1;
-	}
+	SetConsoleCtrlHandler(ConsoleControlHandler, TRUE);
+
+	InitializeCriticalSection(&DisplayLock);
 
 #pragma endregion
 
@@ -113,12 +272,28 @@ int main(int argc, char** argv)
 
 #pragma region wait for threads to terminate
 
-	for (unsigned int i = 0; i < cameraCount; i++)
+	string windowName("Client #1"); // will display only first thread's stream not to clutter the workspace
+	if (DisplayImages) namedWindow(windowName); // OpenCV window to show the image stream on screen
+
+	while (WaitForMultipleObjects(cameraCount, handlesToThreads, TRUE, DisplayImages || FlightRecording || Reconstruction ? DISPLAY_REFRESH_PERIOD : INFINITE) == WAIT_TIMEOUT)
+	{
+		ShowLatestFrame(windowName);
+		int pressedKey = waitKey(1); // the display window has the focus
+		if (_kbhit()) pressedKey = _getch(); // the console has the focus
+		if (FlightRecording && pressedKey == FLIGHT_RECORDER_KEY) TriggerFlightRecorder();
+		if (Reconstruction && pressedKey == RECONSTRUCTION_KEY) SaveReconstruction();
+	}
+
+	delete barrier;
+	if (FlightRecording) delete FlightRecording; // waits for a dump that is still being written
+	if (Reconstruction)
 	{
-		WaitForSingleObject(handlesToThreads[i], INFINITE);
+		SaveReconstruction();
+		delete Reconstruction;
 	}
+	DeleteCriticalSection(&DisplayLock);
 
-	DeleteSynchronizationBarrier(barrier);
+	cout << "Frame buffers: " << PooledAllocator.ToString() << endl;
 
 #pragma endregion
 }
@@ -132,6 +307,12 @@ unsigned __stdcall KinectClientThreadFunction(void* kinectIndex)
 
 	_itoa_s(threadIndex + 1, cameraNameString, 3, 10); // 10 is the radix, camera indices are 1-based
 
+	// pinned before anything is allocated, so that the network and decode buffers end up on this core's NUMA node
+	if (UsePlacement && !Placement.PinCameraThread(threadIndex))
+		cout << "Could not pin the thread of camera #" << cameraNameString << " to its cores" << endl;
+	cout << "Camera #" << cameraNameString << " thread placement: " << Networking::ThreadPlacement::DescribeCurrentThread() << endl;
+	Networking::PooledMatAllocator::UseThreadPool(); // after pinning - the buffers are first touched on this core's NUMA node
+
 	Networking::PacketClient client(std::string("Client #") + cameraNameString);
 	cout << "Initialized client #" << cameraNameString << " successfully" << endl; // not sure this printing is thread sage
 
@@ -140,23 +321,28 @@ unsigned __stdcall KinectClientThreadFunction(void* kinectIndex)
 #pragma region connect to server
 	
 	string serverName = string(SERVER_NAME_HEADER) + string(cameraNameString) + string(SERVER_NAME_TAIL);
-	while (client.ConnectToServer(serverName.c_str(), PORT)); // loop until server goes up 
-	cout << "Connected to server #" << cameraNameString << " successfully" << endl;
+	string port = PORT;
+	if (!ServerHost.empty())
+	{
+		serverName = ServerHost;
+		port = to_string(ServerBasePort + threadIndex);
+	}
+	if (!ConnectAndReceiveMetadata(client, serverName, port, cameraNameString)) return 0; // retries with backoff until server goes up
 
 #pragma endregion
 
 #pragma region obtain metadata from server
 
-	const Networking::ChannelProperties* channelProperties = client.ReceiveMetadataPacket();
+	const Networking::ChannelProperties* channelProperties = client.GetChannelProperties(); // received while connecting - reading it again would eat into the first packet
 	cout << "client #" << cameraNameString << " metadata: " << channelProperties->ToString() << endl;
-	client.AllocateBuffers();
-	cout << "Allocated netwrok buffers for client #" << cameraNameString << endl;
 
 #pragma endregion
 
 #pragma region initialize packet processor
 
-	Networking::NetworkPacketProcessor packetProcessor(channelProperties);
+	Networking::NetworkPacketProcessor packetProcessor(channelProperties, JpegDecodeBands);
+	if (QualityStatisticsRowStride > 0) packetProcessor.CollectQualityStatistics(QualityStatisticsRowStride);
+	Networking::DepthQualityStatistics* qualityStatistics = packetProcessor.QualityStatistics(); // NULL for color streams
 	cout << "Initialized packet processor for client #" << cameraNameString << endl;
 
 #pragma endregion
@@ -165,12 +351,6 @@ unsigned __stdcall KinectClientThreadFunction(void* kinectIndex)
 
 	#pragma region loop initialization
 
-	string windowName = string("Client #") + string(cameraNameString);
-	if (DisplayImages && threadIndex == 0) // will display only first thread's stream not to clutter the workspace
-	{		
-		namedWindow(windowName); // OpenCV window to show the image stream on screen
-	}
-
 	Timer telemetry(string("Kinect #") + string(cameraNameString), FRAMES_BETWEEN_TELEMETRY_MESSAGES);
 
 	Recording::FrameRecorder* frameRecorder = NULL;
@@ -179,88 +359,242 @@ unsigned __stdcall KinectClientThreadFunction(void* kinectIndex)
 	Recording::CalibrationPatternRecorder* calibrationRecorder = NULL;
 	if (RecordCalibrationPattern) calibrationRecorder = new Recording::CalibrationPatternRecorder(RECORDING_DIRECTORY, FRAMES_BETWEEN_SHOTS, threadIndex, CALIBRATION_PATTERN_WIDTH, CALIBRATION_PATTERN_HEIGHT);
 
+	Networking::QualityController* qualityController = NULL;
+	if (AdaptStream) qualityController = new Networking::QualityController(TARGET_LATENCY, channelProperties->ChannelType);
+
+	Networking::FrameBusPublisher* frameBus = NULL;
+	if (PublishFrames) frameBus = new Networking::FrameBusPublisher(threadIndex, channelProperties);
+
+	Networking::ClockModel clockModel; // kept across reconnections - it is still the same board
+
+	Networking::ChangeDetector* changeDetector = NULL;
+	if (DetectChanges) changeDetector = new Networking::ChangeDetector(channelProperties);
+
+	Networking::DepthBackgroundModel* backgroundModel = NULL;
+	if (DetectForeground && channelProperties->ChannelType == Networking::ChannelType::Depth) backgroundModel = new Networking::DepthBackgroundModel(channelProperties);
+	size_t foregroundObjects = 0;
+
+	cv::Matx33f depthIntrinsics;
+	cv::Matx44f cameraToWorld; // camera 0 defines the reconstruction's coordinates
+	bool fuseDepth = Reconstruction && channelProperties->ChannelType == Networking::ChannelType::Depth;
+	if (fuseDepth && !Networking::TsdfVolume::LoadCamera(CALIBRATION_RESULT_FILE, threadIndex, depthIntrinsics, cameraToWorld))
+	{
+		cout << "Client #" << cameraNameString << ": " << CALIBRATION_RESULT_FILE << " has no pose for this camera - left out of the reconstruction" << endl;
+		fuseDepth = false;
+	}
+
+	Networking::RelayServer* relay = NULL;
+	if (RelayPackets) relay = new Networking::RelayServer(RELAY_PORT + threadIndex, channelProperties->ChannelType);
+	double framesetTime = 0; // [ms] on the client's clock, the same for every frame of a synchronized frameset - what the relay stamps its packets with
+
+	Networking::UndistortionStage* undistortion = NULL;
+	if (UndistortFrames && RecordCalibrationPattern) cout << "Client #" << cameraNameString << " records calibration patterns, which must come from distorted frames - ignoring -undistort" << endl;
+	else if (UndistortFrames)
+	{
+		undistortion = Networking::UndistortionStage::Load(CALIBRATION_RESULT_FILE, threadIndex, channelProperties, RectifyFrames);
+		if (!undistortion) cout << "Client #" << cameraNameString << " receives a channel of another resolution than the calibration's - not undistorting" << endl;
+	}
+
+	if (fuseDepth && undistortion) // the volume gets the undistorted (maybe rectified) frames, so it must project with their intrinsics and orientation
+	{
+		depthIntrinsics = undistortion->OutputCameraMatrix();
+		cv::Matx44f rectifiedToCamera = cv::Matx44f::eye();
+		for (int row = 0; row < 3; row++)
+			for (int col = 0; col < 3; col++) rectifiedToCamera(row, col) = undistortion->Rectification()(col, row); // the inverse of a rotation is its transpose
+		cameraToWorld = cameraToWorld * rectifiedToCamera;
+	}
+
+	Networking::LazyFrame frame(&packetProcessor, undistortion); // kept across iterations - an unchanged payload isn't decoded again
+	bool skipStalePackets = LatestFrameOnly && !packetProcessor.DecodesEveryPacket(); // a video stream can't skip packets
+	if (LatestFrameOnly && !skipStalePackets) cout << "Client #" << cameraNameString << " receives a video stream, which has to be decoded in full - ignoring -latest" << endl;
+	if (skipStalePackets) client.SetReceiveBufferSize(LATEST_RECEIVE_BUFFER_SIZE); // kept for the reconnections
+	double lastKeyframeRequest = -KEYFRAME_REQUEST_PERIOD; // [ms]
+
 	unsigned int frameCount = 0;
 	unsigned int savedFrameCount = 0;
+	unsigned int framesWithoutQualityStatistics = 0;
+	bool joining = true; // the thread takes part in the synchronization only once it has its first frame
 
 	#pragma endregion
 
 	while (1)
 	{			
 		telemetry.IterationStarted(threadIndex);
-		DroppingFrame = false;
 
 		#pragma region obtain frame
 
-		Packets[threadIndex] = client.ReceivePacket(); // after it is received, the matrix is stored internally in the client object
-		if (Packets[threadIndex].Data.size() == 0) FirstThreadFinished = true;
+		Packets[threadIndex] = skipStalePackets ? client.ReceiveLatestPacket() : client.ReceivePacket(); // after it is received, the matrix is stored internally in the client object
+
+		if (Packets[threadIndex].Data.size() == 0 || ShuttingDown)
+		{
+			// the other cameras keep streaming (and synchronizing among themselves) while this one reconnects
+			if (!joining) barrier->Leave(&CameraActive[threadIndex]);
+			joining = true;
+
+			if (ShuttingDown) break;
+
+			cout << "Lost connection to server #" << cameraNameString << ", reconnecting" << endl;
+			if (!ConnectAndReceiveMetadata(client, serverName, port, cameraNameString)) break;
+			packetProcessor.StreamInterrupted();
+			continue;
+		}
+
+		clockModel.AddSample(Packets[threadIndex].Timestamp, Packets[threadIndex].ArrivalTime, Packets[threadIndex].Queued);
+		CaptureTimes[threadIndex] = clockModel.ToClientTime(Packets[threadIndex].Timestamp);
 
-		RecieveBarrier: EnterSynchronizationBarrier(barrier, 0); // entering threads wlil block until all the threads reach this point [0 means no flags]
+		// joined a video stream late, lost its references, or a relay subscriber joined late
+		if ((packetProcessor.WaitingForKeyframe() || (relay && relay->KeyframeWanted())) && Networking::ClockModel::Now() - lastKeyframeRequest > KEYFRAME_REQUEST_PERIOD)
+		{
+			Networking::ControlMessage keyframeRequest;
+			keyframeRequest.Type = Networking::ControlMessageType::KeyframeRequest;
+			client.SendControlMessage(keyframeRequest);
+			lastKeyframeRequest = Networking::ClockModel::Now();
+		}
 
-		if (FirstThreadFinished) break; // as soon as one thread is done, everybody's closing their basta
-										// There's a race condition here: if FirstThreadFinished is false, one thread may quickly finish its iteration,
-										// start the following one, grab an empty frame and write true to FirstThreadFinished. Then, the other thread
-										// will read this value and won't be able to finish its last iteration. What a pitty.
+		unsigned long long frameset; // identifies this round of synchronization - only the threads in it decide whether it is dropped
+		if (joining)
+		{
+			frameset = barrier->Join(ReceiveSite, &CameraActive[threadIndex]);
+			joining = false;
+		}
+		else
+		{
+			RecieveBarrier: frameset = barrier->Enter(ReceiveSite); // entering threads wlil block until all the connected threads reach this point
+		}
 		
 		#pragma endregion
 
 		#pragma region synchronize
 
+		framesetTime = CaptureTimes[threadIndex];
 		if (cameraCount > 1)
 		{
-			auto timestamp = Packets[threadIndex].Timestamp;
-			long minGap = 0;
+			double captureTime = CaptureTimes[threadIndex];
+			double minGap = 0;
 			for (unsigned int i = 0; i < cameraCount; i++)		
-				minGap = min(minGap, timestamp - Packets[i].Timestamp);			
-
-			if (minGap < -SYNCHRONIZATION_THRESHOLD) DroppingFrame = true;
+				if (CameraActive[i])
+				{
+					minGap = min(minGap, captureTime - CaptureTimes[i]); // cameras that are reconnecting are left out
+					framesetTime = max(framesetTime, CaptureTimes[i]); // read before the barrier - no camera receives its next frame until everybody passed it
+				}
+
+			// stamped rather than raised and lowered: no thread gets past the next ReceiveSite phase before every one of this phase has read it
+			if (minGap < -SYNCHRONIZATION_THRESHOLD) DroppedFrameset = frameset;
 			
-			EnterSynchronizationBarrier(barrier, 0);
+			barrier->Enter(SynchronizeSite);
 
-			if (DroppingFrame && minGap < -SYNCHRONIZATION_THRESHOLD)
+			bool droppingFrame = DroppedFrameset == frameset;
+			if (droppingFrame && minGap < -SYNCHRONIZATION_THRESHOLD)
 			{				
 				cout << "Client #" << cameraNameString << " has dropped a frame" << endl;
+				packetProcessor.SkipPacket(Packets[threadIndex]); // a video decoder still needs it
+				if (relay && packetProcessor.DecodesEveryPacket()) relay->Forward(Packets[threadIndex], CaptureTimes[threadIndex]); // so do the subscribers'
+				if (FlightRecording) FlightRecording->Record(threadIndex, channelProperties->ChannelType, Packets[threadIndex], CaptureTimes[threadIndex]);
 				continue;
 			}
-			else if (DroppingFrame)
+			else if (droppingFrame)
 			{
 				goto RecieveBarrier;
 			}
 		}
 		// once here - all threads have synchronized their frames :-)
 
+		if (relay) relay->Forward(Packets[threadIndex], framesetTime); // first - the subscribers shouldn't wait for this client's consumers
+
 	#pragma endregion		
 
 		#pragma region record and/or display frame
 
 		frameCount++;
-		auto lastFrame = packetProcessor.ProcessPacket(Packets[threadIndex]);
+		bool frameUnchanged = DetectChanges && changeDetector->PayloadUnchanged(Packets[threadIndex]);
+		frame.SetPacket(&Packets[threadIndex], frameUnchanged); // decoded only once a consumer below asks for the pixels
+
+		// comparing thumbnails takes the pixels, so it is only done when a consumer needs them anyway
+		bool pixelsNeeded = backgroundModel || fuseDepth || (PublishFrames && !PublishCompressed) || (DisplayImages && threadIndex == 0) ||
+			(RecordImages && frameRecorder->WantsFrame(frameCount)) || (RecordCalibrationPattern && calibrationRecorder->WantsFrame(frameCount));
+		if (DetectChanges && !frameUnchanged && pixelsNeeded) frameUnchanged = changeDetector->FrameUnchanged(frame.Pixels());
+
+		if (backgroundModel)
+		{
+			backgroundModel->Update(frame.Pixels());
+			if (backgroundModel->BoundingBoxes().size() != foregroundObjects)
+			{
+				foregroundObjects = backgroundModel->BoundingBoxes().size();
+				printf("Kinect #%s: %d object(s) in front of the background\n", cameraNameString, (int)foregroundObjects);
+			}
+		}
+
+		if (fuseDepth) Reconstruction->Integrate(frame.Pixels(), depthIntrinsics, cameraToWorld); // best with -undistort - the volume assumes a pinhole camera
+
+		if (PublishFrames && !(frameUnchanged && SkipUnchangedPublishing))
+		{
+			if (PublishCompressed) frameBus->PublishPacket(Packets[threadIndex], channelProperties);
+			else frameBus->PublishFrame(frame.Pixels(), Packets[threadIndex].Timestamp, channelProperties);
+		}
 
-		if (RecordImages) frameRecorder->RecordFrame(lastFrame, frameCount);
+		if (RecordImages && !(frameUnchanged && SkipUnchangedRecording)) frameRecorder->RecordFrame(frame, frameCount);
 
 		if (RecordCalibrationPattern)
 		{
-			PatternFound[threadIndex] = calibrationRecorder->DetectCalibrationPattern(lastFrame, frameCount);
-			EnterSynchronizationBarrier(barrier, 0); // this is wasteful in terms of time (even more so when also recording images), but I don't care (only happens when we do calibration)
+			if (frameUnchanged && SkipUnchangedCalibration)
+			{
+				PatternImproves[threadIndex] = false; // same scene - the pattern found (or not) in the previous frame is still there, and was already considered
+			}
+			else
+			{
+				PatternFound[threadIndex] = calibrationRecorder->DetectCalibrationPattern(frame, frameCount);
+				PatternImproves[threadIndex] = PatternFound[threadIndex] && calibrationRecorder->LastPatternImprovesCalibration();
+			}
+			barrier->Enter(CalibrationSite); // this is wasteful in terms of time (even more so when also recording images), but I don't care (only happens when we do calibration)
 			bool everyoneFound = true;
+			bool someoneImproves = false; // the recorded frames must stay aligned across cameras, so either everybody records or nobody does
 			for (unsigned int i = 0; i < cameraCount; i++)
 			{
-				everyoneFound = everyoneFound && PatternFound[i];
+				everyoneFound = everyoneFound && CameraActive[i] && PatternFound[i]; // no patterns are recorded while a camera is reconnecting
+				someoneImproves = someoneImproves || PatternImproves[i];
 			}
-			if (everyoneFound) 
+			if (everyoneFound && someoneImproves) 
 				calibrationRecorder->RecordLastCalibrationPattern();
 		}
 
-		if (DisplayImages && threadIndex == 0) // remove the index == 0 condition if you wish to display the stream for every client
+		if (DisplayImages && threadIndex == 0 && !(frameUnchanged && SkipUnchangedDisplay)) // the frame is shown by the main thread, which keeps GUI work off the camera's cores
+		{
+			EnterCriticalSection(&DisplayLock);
+			frame.Pixels().copyTo(DisplayFrame); // reuses DisplayFrame's buffer
+			if (backgroundModel)
+				for (auto& box : backgroundModel->BoundingBoxes()) rectangle(DisplayFrame, box, Scalar::all(65535), 2); // beyond any depth - white once scaled
+			DisplayChannelProperties = channelProperties;
+			DisplayFrameReady = true;
+			LeaveCriticalSection(&DisplayLock);
+		}
+
+		if (qualityStatistics) // the statistics are gathered as the frame is decoded - a frame the consumers skipped is decoded for them only now and then
+		{
+			if (frame.IsDecoded()) framesWithoutQualityStatistics = 0;
+			else if (++framesWithoutQualityStatistics >= QUALITY_STATISTICS_DECODE_PERIOD)
+			{
+				frame.Decode();
+				qualityStatistics->AddForcedDecode(frame.DecodeTime()); // counted in the statistics' cost
+				framesWithoutQualityStatistics = 0;
+			}
+		}
+
+		if (AdaptStream) // after the consumers - only then is it known whether the frame was decoded
 		{
-			if (channelProperties->ChannelType == Networking::ChannelType::Depth) // lastFrame contains depth in mm but needs to be scaled for visualizatiuon purposes
-				lastFrame = ((1 << channelProperties->PixelSize * 8) / channelProperties->DepthExpectedMax) * lastFrame;
-			imshow(windowName, lastFrame);
-			waitKey(1);
+			Networking::ControlMessage controlMessage;
+			if (qualityController->Update((unsigned int)Packets[threadIndex].Data.size(), client.PendingBytes(), frame.DecodeTime(), controlMessage))
+				client.SendControlMessage(controlMessage);
 		}
 
 	#pragma endregion
 
-		telemetry.IterationEnded(Packets[threadIndex].Data.size());
+		if (telemetry.IterationEnded(Packets[threadIndex].Data.size()) && qualityStatistics) // the statistics cover the same window as the rate and bandwidth
+		{
+			printf("Kinect #%s quality: %s\n", cameraNameString, qualityStatistics->ToString().c_str());
+			qualityStatistics->Reset();
+		}
+
+		if (FlightRecording) FlightRecording->Record(threadIndex, channelProperties->ChannelType, Packets[threadIndex], CaptureTimes[threadIndex]); // takes the payload - last
 	}
 
 #pragma endregion
@@ -270,11 +604,93 @@ unsigned __stdcall KinectClientThreadFunction(void* kinectIndex)
 	client.CloseConnection();
 
 	printf("Average bandwidth for Kinect #%s on this session was: %2.1f [Mbps]\n", cameraNameString, telemetry.AverageBandwidth());	
+	if (LatestFrameOnly) printf("Kinect #%s skipped %d stale frames\n", cameraNameString, client.SkippedPackets());
+	printf("Kinect #%s clock: %s\n", cameraNameString, clockModel.ToString().c_str());
+	printf("Kinect #%s decoded %d of %d frames\n", cameraNameString, frame.DecodedFrames(), frame.Frames());
+	if (DetectChanges) printf("Kinect #%s received %d unchanged frames\n", cameraNameString, changeDetector->UnchangedFrames());
+	if (relay) printf("Kinect #%s relay: %s\n", cameraNameString, relay->ToString().c_str());
 
 	if (RecordImages) delete frameRecorder;
 	if (RecordCalibrationPattern) delete calibrationRecorder;
+	if (AdaptStream) delete qualityController;
+	if (PublishFrames) delete frameBus;
+	if (DetectChanges) delete changeDetector;
+	if (backgroundModel) delete backgroundModel;
+	if (undistortion) delete undistortion;
+	if (relay) delete relay;
 
 	return 0;
 
 #pragma endregion
+}
+
+bool ConnectAndReceiveMetadata(Networking::PacketClient& client, const string& serverName, const string& port, const char* cameraNameString)
+{
+	while (client.ConnectToServerWithBackoff(serverName.c_str(), port.c_str(), ShuttingDown))
+	{
+		try
+		{
+			client.ReceiveMetadataPacket();
+			client.AllocateBuffers(); // buffers from a previous connection are kept
+			cout << "Connected to server #" << cameraNameString << " successfully" << endl;
+			return true;
+		}
+		catch (const runtime_error& e)
+		{
+			cout << "Client #" << cameraNameString << ": " << e.what() << endl;
+			client.CloseConnection();
+			Sleep(RECONNECTION_DELAY_AFTER_BAD_METADATA);
+		}
+	}
+
+	return false; // shutting down
+}
+
+BOOL WINAPI ConsoleControlHandler(DWORD controlType)
+{
+	if (controlType == CTRL_BREAK_EVENT && FlightRecording)
+	{
+		TriggerFlightRecorder();
+		return TRUE;
+	}
+
+	if (controlType != CTRL_C_EVENT || ShuttingDown)
+		return FALSE; // a second Ctrl+C terminates the process right away
+
+	cout << "Shutting down (press Ctrl+C again to terminate immediately)" << endl;
+	ShuttingDown = true; // each thread notices it once its current frame arrives (or its reconnection attempt fails)
+	return TRUE;
+}
+
+void ShowLatestFrame(const string& windowName)
+{
+	EnterCriticalSection(&DisplayLock);
+
+	if (DisplayFrameReady)
+	{
+		Mat frame = DisplayFrame;
+		if (DisplayChannelProperties->ChannelType == Networking::ChannelType::Depth) // DisplayFrame contains depth in mm but needs to be scaled for visualizatiuon purposes
+			frame = ((1 << DisplayChannelProperties->PixelSize * 8) / DisplayChannelProperties->DepthExpectedMax) * DisplayFrame;
+		imshow(windowName, frame);
+		DisplayFrameReady = false;
+	}
+
+	LeaveCriticalSection(&DisplayLock);
+}
+
+void TriggerFlightRecorder()
+{
+	if (FlightRecording->Trigger())
+		cout << "Flight recorder: dumping " << FlightRecording->ToString() << endl;
+	else
+		cout << "Flight recorder: still writing the previous dump" << endl;
+}
+
+void SaveReconstruction()
+{
+	string fileName = string(RECORDING_DIRECTORY) + "/Reconstruction_" + to_string(++SavedReconstructions) + ".ply";
+	if (Reconstruction->SavePly(fileName))
+		cout << "Reconstruction: " << Reconstruction->ToString() << ", saved to " << fileName << endl;
+	else
+		cout << "Reconstruction: could not write " << fileName << endl;
 }
\ No newline at end of file
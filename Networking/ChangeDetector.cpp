@@ -0,0 +1,70 @@
+#include "ChangeDetector.h"
+#include <opencv2/imgproc/imgproc.hpp>
+
+namespace Networking
+{
+	const int ThumbnailDownscale = 16; // 1920 x 1080 -> 120 x 67, 512 x 424 -> 32 x 26
+	const double ColorChangeThreshold = 2.0; // [gray levels], above the JPEG noise of a static scene
+	const double IrChangeThreshold = 2.0; // [gray levels]
+	const double DepthChangeThreshold = 15.0; // [mm], above the depth noise and the flicker of invalid pixels along edges
+
+	ChangeDetector::ChangeDetector(const ChannelProperties* channelProperties) : _lastPayloadHash(0), _unchangedFrames(0)
+	{
+		switch (channelProperties->ChannelType)
+		{
+		case ChannelType::Color:
+		case ChannelType::ColorH264:
+		case ChannelType::ColorHevc:
+			_threshold = ColorChangeThreshold;
+			break;
+		case ChannelType::Depth:
+			_threshold = DepthChangeThreshold;
+			break;
+		case ChannelType::Ir:
+			_threshold = IrChangeThreshold;
+			break;
+		default:
+			throw std::runtime_error("Could not identify channel type");
+		};
+	}
+
+	bool ChangeDetector::PayloadUnchanged(const NetworkPacket& packet)
+	{
+		unsigned long long hash = HashPayload(packet.Data);
+		bool unchanged = hash == _lastPayloadHash;
+		_lastPayloadHash = hash;
+
+		if (unchanged) _unchangedFrames++;
+		return unchanged;
+	}
+
+	bool ChangeDetector::FrameUnchanged(const cv::Mat& frame)
+	{
+		cv::resize(frame, _thumbnail, cv::Size(frame.cols / ThumbnailDownscale, frame.rows / ThumbnailDownscale), 0, 0, cv::INTER_AREA); // averages, so sensor noise mostly cancels out
+
+		if (_referenceThumbnail.size() == _thumbnail.size() && _referenceThumbnail.type() == _thumbnail.type())
+		{
+			double meanDifference = cv::norm(_thumbnail, _referenceThumbnail, cv::NORM_L1) / (_thumbnail.total() * _thumbnail.channels());
+			if (meanDifference < _threshold)
+			{
+				_unchangedFrames++;
+				return true;
+			}
+		}
+
+		_thumbnail.copyTo(_referenceThumbnail);
+		return false;
+	}
+
+	unsigned long long ChangeDetector::HashPayload(const std::vector<uchar>& payload)
+	{
+		unsigned long long hash = 14695981039346656037ULL; // 64 bit FNV-1a
+		for (uchar byte : payload)
+		{
+			hash ^= byte;
+			hash *= 1099511628211ULL;
+		}
+
+		return hash;
+	}
+}
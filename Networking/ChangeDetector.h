@@ -0,0 +1,31 @@
+#pragma once
+
+#include "PacketClient.h"
+#include <opencv2/core/core.hpp>
+
+namespace Networking
+{
+	// tells whether a frame differs from what the consumers have already seen, so that they can skip the work for a static scene
+	// two checks, cheapest first: a hash of the compressed payload (identical bytes - the frame needn't even be decoded), and the mean
+	// absolute difference between a low resolution thumbnail of the decoded frame and that of the last frame that was deemed changed.
+	// Comparing against the last changed frame (rather than the previous one) means slow motion still adds up to a change.
+	class ChangeDetector
+	{
+		unsigned long long _lastPayloadHash;
+		cv::Mat _thumbnail;
+		cv::Mat _referenceThumbnail; // of the last changed frame
+		double _threshold; // mean absolute difference per thumbnail pixel, in the units of the decoded frame
+		unsigned int _unchangedFrames;
+
+	public:
+		ChangeDetector(const ChannelProperties* channelProperties);
+
+		bool PayloadUnchanged(const NetworkPacket& packet); // true if the payload is byte for byte the previous one
+		bool FrameUnchanged(const cv::Mat& frame); // true if the decoded frame is close enough to the last changed one
+
+		unsigned int UnchangedFrames() const { return _unchangedFrames; } // counts both kinds
+
+	private:
+		static unsigned long long HashPayload(const std::vector<uchar>& payload);
+	};
+}
@@ -7,6 +7,8 @@ namespace Networking
 		switch (type)
 		{
 		case ChannelType::Color:
+		case ChannelType::ColorH264:
+		case ChannelType::ColorHevc:
 			Height = 1080;
 			Width = 1920;
 			PixelType = CV_8UC3; // compressed without the alpha
@@ -37,6 +39,12 @@ namespace Networking
 		case ChannelType::Color: 
 			channelType = std::string("Color");
 			break;
+		case ChannelType::ColorH264:
+			channelType = std::string("Color (H.264)");
+			break;
+		case ChannelType::ColorHevc:
+			channelType = std::string("Color (HEVC)");
+			break;
 		case ChannelType::Depth:
 			channelType = std::string("Depth");
 			break;
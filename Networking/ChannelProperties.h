@@ -8,9 +8,11 @@ namespace Networking
 {
 	enum ChannelType
 	{
-		Color = 1,
+		Color = 1, // JPEG per frame
 		Ir = 2,
-		Depth = 4
+		Depth = 4,
+		ColorH264 = 8, // an inter-frame coded color stream - every packet is an access unit (Annex B), decoding needs every packet in order
+		ColorHevc = 16
 	};	 
 
 	struct ChannelProperties
@@ -26,5 +28,8 @@ namespace Networking
 
 		ChannelProperties(enum ChannelType type);
 		std::string ToString() const;
+
+		bool IsColor() const { return (ChannelType & (Color | ColorH264 | ColorHevc)) != 0; }
+		bool IsVideo() const { return (ChannelType & (ColorH264 | ColorHevc)) != 0; } // inter-frame coded
 	};
 }
\ No newline at end of file
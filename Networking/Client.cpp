@@ -8,11 +8,18 @@
 
 #include "Client.h"
 
+#define INITIAL_RECONNECTION_DELAY 100 // [ms], doubled after every failed attempt
+#define MAXIMAL_RECONNECTION_DELAY 5000 // [ms]
+#define FAILED_ATTEMPTS_BEFORE_RESOLVING_AGAIN 5 // the board may have come back with a different address
+
 #pragma region Constructors and Distructors
 
 Client::~Client() 
 {
 	CloseConnection();
+
+	if (_serverAddress) freeaddrinfo(_serverAddress);
+	if (_winsockInitialized) WSACleanup();
 }
 
 #pragma endregion
@@ -26,32 +33,49 @@ int Client::ConnectToServer(const char* serverName, const char* portNumber)
 	int iResult;
 
 	// Initialize Winsock
-	iResult = WSAStartup(MAKEWORD(2, 2), &wsaData);
-	if (iResult != 0) {
-		printf("%s: WSAStartup failed: %d\n", _name.c_str(), iResult);
-		return 1;
+	if (!_winsockInitialized)
+	{
+		iResult = WSAStartup(MAKEWORD(2, 2), &wsaData);
+		if (iResult != 0) {
+			printf("%s: WSAStartup failed: %d\n", _name.c_str(), iResult);
+			return 1;
+		}
+		_winsockInitialized = true;
 	}
 
-	struct addrinfo *result = NULL,
-		*ptr = NULL,
-		hints;
+	CloseConnection(); // in case a previous connection is still open
+
+	if (_serverAddress && (_resolvedServerName != serverName || _resolvedPortNumber != portNumber || _failedAttemptsWithCachedAddress >= FAILED_ATTEMPTS_BEFORE_RESOLVING_AGAIN))
+	{
+		freeaddrinfo(_serverAddress);
+		_serverAddress = NULL;
+	}
 
-	ZeroMemory(&hints, sizeof(hints));
-	hints.ai_family = AF_UNSPEC;
-	hints.ai_socktype = SOCK_STREAM;
-	hints.ai_protocol = IPPROTO_TCP;
+	if (!_serverAddress)
+	{
+		struct addrinfo hints;
+
+		ZeroMemory(&hints, sizeof(hints));
+		hints.ai_family = AF_UNSPEC;
+		hints.ai_socktype = SOCK_STREAM;
+		hints.ai_protocol = IPPROTO_TCP;
+
+		// Resolve the server address and port
+		iResult = getaddrinfo(serverName, portNumber, &hints, &_serverAddress);
+		if (iResult != 0) {
+			printf("%s: getaddrinfo failed: %d\n", _name.c_str(), iResult);
+			_serverAddress = NULL;
+			return 1;
+		}
 
-	// Resolve the server address and port
-	iResult = getaddrinfo(serverName, portNumber, &hints, &result);
-	if (iResult != 0) {
-		printf("%s: getaddrinfo failed: %d\n", _name.c_str(), iResult);
-		WSACleanup();
-		return 1;
+		_resolvedServerName = serverName;
+		_resolvedPortNumber = portNumber;
+		_failedAttemptsWithCachedAddress = 0;
 	}
 
 	// Attempt to connect to the first address returned by
 	// the call to getaddrinfo
-	ptr = result;
+	struct addrinfo* ptr = _serverAddress;
 
 	while (ptr != NULL)
 	{
@@ -60,11 +84,12 @@ int Client::ConnectToServer(const char* serverName, const char* portNumber)
 
 		if (_sockfd == INVALID_SOCKET) {
 			printf("%s: Error at socket(): %ld\n", _name.c_str(), WSAGetLastError());
-			freeaddrinfo(result);
-			WSACleanup();
 			return 1;
 		}
 
+		// before connecting - the TCP window scale is agreed on during the handshake
+		if (_receiveBufferSize > 0) setsockopt(_sockfd, SOL_SOCKET, SO_RCVBUF, (const char*)&_receiveBufferSize, sizeof(_receiveBufferSize));
+
 		// Connect to server.
 		iResult = connect(_sockfd, ptr->ai_addr, (int)ptr->ai_addrlen);
 	
@@ -75,38 +100,103 @@ int Client::ConnectToServer(const char* serverName, const char* portNumber)
 		ptr = ptr->ai_next;
 	}
 
-	freeaddrinfo(result);
-
 	if (_sockfd == INVALID_SOCKET) {
 		printf("%s: Unable to connect to server!\n", _name.c_str());
-		WSACleanup();
+		_failedAttemptsWithCachedAddress++;
 		return 1;
 	}
 
-	// shutdown the connection for sending since no more data will be sent
-	// the client can still use the ConnectSocket for receiving data
-	iResult = shutdown(_sockfd, SD_SEND);
-	if (iResult == SOCKET_ERROR) {
-		printf("%s: shutdown failed: %d\n", _name.c_str(), WSAGetLastError());
-		closesocket(_sockfd);
-		WSACleanup();
-		return 1;
-	}
+	_failedAttemptsWithCachedAddress = 0;
+
+	// the sending direction stays open - it carries control messages back to the server
 
 	return 0;
 }
 
+bool Client::ConnectToServerWithBackoff(const char* serverName, const char* portNumber, const volatile bool& cancelled)
+{
+	DWORD delay = INITIAL_RECONNECTION_DELAY;
+
+	while (!cancelled)
+	{
+		if (ConnectToServer(serverName, portNumber) == 0)
+			return true;
+
+		Sleep(delay);
+		delay = min(2 * delay, (DWORD)MAXIMAL_RECONNECTION_DELAY);
+	}
+
+	return false;
+}
+
 void Client::CloseConnection()
 {
-	// cleanup
-	closesocket(_sockfd);
-	WSACleanup();
+	// cleanup (winsock itself stays initialized until the client is destroyed, so that reconnecting is cheap)
+	if (_sockfd != INVALID_SOCKET)
+	{
+		closesocket(_sockfd);
+		_sockfd = INVALID_SOCKET;
+	}
+}
+
+void Client::SetReceiveBufferSize(int size)
+{
+	_receiveBufferSize = size;
+
+	if (_sockfd != INVALID_SOCKET && setsockopt(_sockfd, SOL_SOCKET, SO_RCVBUF, (const char*)&_receiveBufferSize, sizeof(_receiveBufferSize)) == SOCKET_ERROR)
+		printf("%s: setsockopt(SO_RCVBUF) failed: %d\n", _name.c_str(), WSAGetLastError());
 }
 
 #pragma endregion
 
 #pragma region send and recieve methods
 
+int Client::SendBuffer(const char* message, int length)
+{
+	int totalSent = 0;
+
+	while (totalSent < length)
+	{
+		int sent = send(_sockfd, message + totalSent, length - totalSent, 0);
+		if (sent == SOCKET_ERROR)
+		{
+			printf("%s: send failed: %d\n", _name.c_str(), WSAGetLastError());
+			return -1;
+		}
+		totalSent += sent;
+	}
+
+	return totalSent;
+}
+
+int Client::SendBufferWithoutBlocking(const char* message, int length)
+{
+	u_long nonBlocking = 1, blocking = 0;
+	if (ioctlsocket(_sockfd, FIONBIO, &nonBlocking) == SOCKET_ERROR) return -1;
+
+	int sent = send(_sockfd, message, length, 0);
+	int error = sent == SOCKET_ERROR ? WSAGetLastError() : 0;
+	ioctlsocket(_sockfd, FIONBIO, &blocking); // the receiving side relies on blocking calls
+
+	if (error == WSAEWOULDBLOCK) return 0;
+	if (error != 0)
+	{
+		printf("%s: send failed: %d\n", _name.c_str(), error);
+		return -1;
+	}
+
+	return sent;
+}
+
+unsigned int Client::PendingBytes()
+{
+	u_long pendingBytes = 0;
+	if (ioctlsocket(_sockfd, FIONREAD, &pendingBytes) == SOCKET_ERROR)
+		return 0;
+
+	return pendingBytes;
+}
+
 int Client::ReceiveMessage(char* message, int length)
 {
 	int numBytes;
@@ -125,7 +215,7 @@ int Client::waitUntilReceived(char* buffer, int length)
 	while (totalReceived < length)
 	{
 		int received = ReceiveMessage(buffer + totalReceived, length - totalReceived);
-		if (received == 0)
+		if (received <= 0) // a failed recv (e.g. connection reset) is treated the same as an orderly close
 		{
 			printf("%s: Server closed connection\n", _name.c_str());
 			break;
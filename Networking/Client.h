@@ -16,15 +16,31 @@ class Client
 {
 	SOCKET _sockfd = INVALID_SOCKET;
 
+	bool _winsockInitialized = false; // WSAStartup is called once per client, not once per connection attempt
+
+	// the resolved server address is cached between connection attempts (resolving a .local name is slow)
+	struct addrinfo* _serverAddress = NULL;
+	string _resolvedServerName;
+	string _resolvedPortNumber;
+	unsigned int _failedAttemptsWithCachedAddress = 0;
+
+	int _receiveBufferSize = 0; // [bytes] of the socket's receive buffer, 0 - the system's default
+
 public:
 	Client(string name) : _name(name) {};
 
 	int ConnectToServer(const char* serverName, const char* portNumber);
+	bool ConnectToServerWithBackoff(const char* serverName, const char* portNumber, const volatile bool& cancelled); // blocks until connected (returns true) or until cancelled is raised (returns false)
 	void CloseConnection();
+	void SetReceiveBufferSize(int size); // [bytes], applied to the current connection and to every one after it
 
 	~Client();
 
+	unsigned int PendingBytes(); // bytes received by the socket but not read yet
+
 protected:
+	int SendBuffer(const char* message, int length); // returns the number of bytes sent, or -1 on failure
+	int SendBufferWithoutBlocking(const char* message, int length); // sends what fits in the socket's send buffer right away - returns the number of bytes sent (possibly 0), or -1 on failure
 	int ReceiveMessage(char* message, int length);
 	int waitUntilReceived(char* buffer, int length); // will not return before length bytes are received
 
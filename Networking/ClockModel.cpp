@@ -0,0 +1,117 @@
+#include "ClockModel.h"
+#include <math.h>
+#include <stdio.h>
+
+namespace Networking
+{
+	const double ForgettingFactor = 0.999; // per sample - the regression effectively spans the last ~1000 samples (~30 s at 30 Hz)
+	const unsigned int WarmupSamples = 30; // until then, the clocks are assumed to run at the same rate
+	const double MinimalSpanForRate = 10000; // [ms] of server time the samples must span before the rate is estimated
+	const double MaximalDrift = 500e-6; // a rate further off than this is a bad estimate, not a crystal
+
+	const double DelayTolerance = 2; // [ms] above the model a sample still counts fully
+	const double DelayScale = 2; // [ms] - a sample 10 ms late gets ~1/17 of the weight
+	const double ClockJumpThreshold = 100; // [ms] ahead of the model, or back in server time, that can only mean the server's clock was set
+
+	ClockModel::ClockModel()
+	{
+		Reset();
+	}
+
+	void ClockModel::Reset()
+	{
+		_initialized = false;
+		_serverOrigin = _clientOrigin = 0;
+		_sumW = _sumX = _sumY = _sumXX = _sumXY = 0;
+		_minimalY = 0;
+		_lastX = 0;
+		_offset = 0;
+		_rate = 1;
+		_samples = 0;
+	}
+
+	void ClockModel::AddSample(Timestamp serverTime, double arrivalTime, bool queued)
+	{
+		double serverMilliseconds = 1000. * serverTime.Seconds + serverTime.Milliseconds;
+		if (!_initialized)
+		{
+			_serverOrigin = serverMilliseconds;
+			_clientOrigin = arrivalTime;
+			_initialized = true;
+		}
+
+		double x = serverMilliseconds - _serverOrigin;
+		double y = arrivalTime - _clientOrigin;
+		double residual = y - Predict(x); // the delay of this sample, relative to the lowest delays seen
+
+		if (_samples > 0)
+		{
+			// a sample can be late for many reasons (congestion, a client falling behind), but never early - nor can frames go back in time
+			if (residual < -ClockJumpThreshold || _lastX - x > ClockJumpThreshold)
+			{
+				printf("Server clock jumped by %2.0f [ms], restarting its clock model\n", residual < -ClockJumpThreshold ? -residual : x - _lastX);
+				Reset();
+				AddSample(serverTime, arrivalTime, queued);
+				return;
+			}
+		}
+
+		_lastX = x;
+		if (queued && _samples > 0) return; // arrived some time before it was read - the model needs its first sample, though
+
+		double weight = 1;
+		if (_samples > 0 && residual > DelayTolerance)
+		{
+			double excess = (residual - DelayTolerance) / DelayScale;
+			weight = 1 / (1 + excess * excess);
+		}
+
+		_sumW = ForgettingFactor * _sumW + weight;
+		_sumX = ForgettingFactor * _sumX + weight * x;
+		_sumY = ForgettingFactor * _sumY + weight * y;
+		_sumXX = ForgettingFactor * _sumXX + weight * x * x;
+		_sumXY = ForgettingFactor * _sumXY + weight * x * y;
+		_samples++;
+
+		if (_samples <= WarmupSamples || x - (_sumX / _sumW) < MinimalSpanForRate / 2)
+		{
+			// too early for a regression - the lowest delay seen so far, with the clocks running at the same rate
+			_minimalY = _samples == 1 ? y - x : (y - x < _minimalY ? y - x : _minimalY);
+			_rate = 1;
+			_offset = _minimalY; // not the weighted mean - that includes the queuing delay, and the offset would jump by it after warm-up
+			return;
+		}
+
+		double meanX = _sumX / _sumW;
+		double meanY = _sumY / _sumW;
+		double varianceX = _sumXX / _sumW - meanX * meanX;
+		double covarianceXY = _sumXY / _sumW - meanX * meanY;
+
+		double rate = covarianceXY / varianceX;
+		_rate = fabs(rate - 1) < MaximalDrift ? rate : 1;
+		_offset = meanY - _rate * meanX;
+	}
+
+	double ClockModel::ToClientTime(Timestamp serverTime) const
+	{
+		double x = 1000. * serverTime.Seconds + serverTime.Milliseconds - _serverOrigin;
+		return _clientOrigin + Predict(x);
+	}
+
+	std::string ClockModel::ToString() const
+	{
+		char description[128];
+		sprintf_s(description, "offset %2.1f [ms], drift %2.1f [ppm] (%d samples)", Offset(), Drift(), _samples);
+		return description;
+	}
+
+	double ClockModel::Now()
+	{
+		static LARGE_INTEGER frequency = { 0 };
+		if (frequency.QuadPart == 0) QueryPerformanceFrequency(&frequency);
+
+		LARGE_INTEGER now;
+		QueryPerformanceCounter(&now);
+		return 1000. * now.QuadPart / frequency.QuadPart;
+	}
+}
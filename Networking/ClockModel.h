@@ -0,0 +1,47 @@
+#pragma once
+
+#include "PacketClient.h"
+#include <string>
+
+namespace Networking
+{
+	// maps the timestamps of one server (a Jetson board, with its own clock) onto the client's clock
+	// every packet gives a sample - its server timestamp and the client time it arrived at. The arrival time is the capture time on the
+	// client's clock plus a delay that is never negative (transmission, queuing), so the model follows the lower envelope of the samples:
+	// a running weighted regression in which samples that arrived later than the model predicts are downweighted, while earlier ones
+	// count fully. The regression forgets old samples exponentially, so it tracks the drift of the board's clock.
+	// Samples that waited in the client's socket (see NetworkPacket::Queued) say nothing of the delay, so they are left out of the fit;
+	// a client falling behind must not pass for network delay. Only a server timestamp far off the model in a way no delay can explain -
+	// ahead of it, or going back in time - restarts the model; a sample that is merely late never does.
+	class ClockModel
+	{
+		bool _initialized;
+		double _serverOrigin; // [ms], server time of the first sample - the regression is centered there to keep the sums well conditioned
+		double _clientOrigin; // [ms], arrival time of the first sample
+
+		double _sumW, _sumX, _sumY, _sumXX, _sumXY; // exponentially weighted sums of the samples (x - server time, y - arrival time, both from the origins)
+		double _minimalY; // lower envelope of y - x, until the samples span enough for the regression
+		double _lastX; // of the previous sample
+
+		double _offset; // [ms], client time (from origin) at the server origin
+		double _rate; // client milliseconds per server millisecond (1 + drift)
+
+		unsigned int _samples;
+
+	public:
+		ClockModel();
+
+		void AddSample(Timestamp serverTime, double arrivalTime, bool queued = false); // arrivalTime - [ms] on the client's clock (see Now); queued - see NetworkPacket
+		double ToClientTime(Timestamp serverTime) const; // [ms] on the client's clock
+
+		double Offset() const { return _offset; } // [ms], how far the client clock has moved against the server clock since the first sample
+		double Drift() const { return (_rate - 1) * 1e6; } // [ppm]
+		std::string ToString() const;
+
+		static double Now(); // [ms], the client's clock
+
+	private:
+		void Reset();
+		double Predict(double x) const { return _offset + _rate * x; }
+	};
+}
@@ -0,0 +1,49 @@
+#include "ControlMessage.h"
+
+#include <stdexcept>
+#include <string>
+#include <string.h>
+
+namespace Networking
+{
+	const unsigned int BitsInByte = 8;
+
+	ControlMessage::ControlMessage() : Type(ControlMessageType::QualityReport), JpegQuality(MaximalJpegQuality), FrameRateDivider(1), ResolutionDivider(1),
+		QueueDepth(0), DecodeTime(0), EstimatedLatency(0)
+	{
+	}
+
+	void ControlMessage::Serialize(unsigned char* buffer) const
+	{
+		unsigned short decodeTime = (unsigned short)(DecodeTime * 10);
+
+		memset(buffer, 0, BytesInControlMessage);
+		buffer[0] = (unsigned char)Type;
+		buffer[1] = JpegQuality;
+		buffer[2] = FrameRateDivider;
+		buffer[3] = ResolutionDivider;
+		buffer[4] = QueueDepth & 0xFF;
+		buffer[5] = QueueDepth >> BitsInByte;
+		buffer[6] = decodeTime & 0xFF;
+		buffer[7] = decodeTime >> BitsInByte;
+		buffer[8] = EstimatedLatency & 0xFF;
+		buffer[9] = EstimatedLatency >> BitsInByte;
+	}
+
+	ControlMessage ControlMessage::Deserialize(const unsigned char* buffer)
+	{
+		if (buffer[0] != ControlMessageType::QualityReport && buffer[0] != ControlMessageType::KeyframeRequest)
+			throw std::runtime_error("Unidentified control message type " + std::to_string(buffer[0]));
+
+		ControlMessage message;
+		message.Type = (enum ControlMessageType)buffer[0];
+		message.JpegQuality = buffer[1];
+		message.FrameRateDivider = buffer[2] ? buffer[2] : 1;
+		message.ResolutionDivider = buffer[3] ? buffer[3] : 1;
+		message.QueueDepth = buffer[4] + (buffer[5] << BitsInByte);
+		message.DecodeTime = (buffer[6] + (buffer[7] << BitsInByte)) / 10.f;
+		message.EstimatedLatency = buffer[8] + (buffer[9] << BitsInByte);
+
+		return message;
+	}
+}
@@ -0,0 +1,32 @@
+#pragma once
+
+namespace Networking
+{
+	const unsigned int BytesInControlMessage = 12;
+	const unsigned char MaximalJpegQuality = 95;
+
+	enum ControlMessageType
+	{
+		QualityReport = 1, // the client's state, along with the stream settings it asks the server to use
+		KeyframeRequest = 2 // a video stream's decoder lost its references (or never had them) - only the type is meaningful
+	};
+
+	// sent by the client to the server on the otherwise unused sending direction of the connection
+	// layout (little-endian): type (1), jpeg quality (1), frame rate divider (1), resolution divider (1), queue depth [frames] (2),
+	//                         decode time [0.1 ms] (2), estimated latency [ms] (2), reserved (2)
+	struct ControlMessage
+	{
+		enum ControlMessageType Type;
+		unsigned char JpegQuality; // 1-100, only used by color streams
+		unsigned char FrameRateDivider; // 1 - every frame, n - every n-th frame
+		unsigned char ResolutionDivider; // 1 - full resolution, n - width and height divided by n
+		unsigned short QueueDepth; // frames waiting in the client's socket buffer
+		float DecodeTime; // [ms]
+		unsigned short EstimatedLatency; // [ms]
+
+		ControlMessage();
+
+		void Serialize(unsigned char* buffer) const; // writes BytesInControlMessage bytes
+		static ControlMessage Deserialize(const unsigned char* buffer); // reads BytesInControlMessage bytes
+	};
+}
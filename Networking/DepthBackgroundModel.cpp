@@ -0,0 +1,126 @@
+#include "DepthBackgroundModel.h"
+#include <opencv2/imgproc/imgproc.hpp>
+#include <emmintrin.h> // SSE2
+
+namespace Networking
+{
+	const float BackgroundLearningRate = 0.02f; // the model follows the background over ~50 frames
+	const float ForegroundLearningRate = 0.001f; // an object that stays put becomes background after ~30 s
+	const float ForegroundDeviations = 3.f;
+	const float InitialDeviation = 20.f; // [mm], of a pixel's first valid depth
+	const float MinimalDeviation = 5.f; // [mm], Kinect v2 depth noise is a few mm, growing with distance...
+	const float MinimalRelativeDeviation = 0.005f; // ...by about this fraction of the depth
+	const int MinimalBlobArea = 200; // [pixels], smaller foreground blobs are noise
+
+	DepthBackgroundModel::DepthBackgroundModel(const ChannelProperties* channelProperties) :
+		_mean(channelProperties->Height, channelProperties->Width, CV_32FC1, cv::Scalar(0)),
+		_variance(channelProperties->Height, channelProperties->Width, CV_32FC1, cv::Scalar(0)),
+		_foreground(channelProperties->Height, channelProperties->Width, CV_8UC1, cv::Scalar(0))
+	{
+		if (channelProperties->ChannelType != ChannelType::Depth) throw std::runtime_error("A background model needs a depth channel");
+	}
+
+	void DepthBackgroundModel::Update(const cv::Mat& depth)
+	{
+		CV_Assert(depth.type() == CV_16UC1 && depth.size() == _mean.size());
+
+		for (int row = 0; row < depth.rows; row++)
+			UpdateRow(depth.ptr<unsigned short>(row), _mean.ptr<float>(row), _variance.ptr<float>(row), _foreground.ptr<unsigned char>(row), depth.cols);
+
+		FindBoundingBoxes();
+	}
+
+	// updates four pixels and returns their foreground mask (all ones - foreground)
+	static inline __m128 UpdatePixels(__m128 depth, float* meanPointer, float* variancePointer)
+	{
+		const __m128 zero = _mm_setzero_ps();
+		const __m128 backgroundRate = _mm_set1_ps(BackgroundLearningRate);
+		const __m128 foregroundRate = _mm_set1_ps(ForegroundLearningRate);
+		const __m128 squaredDeviations = _mm_set1_ps(ForegroundDeviations * ForegroundDeviations);
+		const __m128 initialVariance = _mm_set1_ps(InitialDeviation * InitialDeviation);
+		const __m128 minimalDeviation = _mm_set1_ps(MinimalDeviation);
+		const __m128 minimalRelativeDeviation = _mm_set1_ps(MinimalRelativeDeviation);
+
+		__m128 mean = _mm_loadu_ps(meanPointer);
+		__m128 variance = _mm_loadu_ps(variancePointer);
+
+		__m128 valid = _mm_cmpgt_ps(depth, zero);
+		__m128 known = _mm_cmpgt_ps(mean, zero);
+
+		__m128 difference = _mm_sub_ps(depth, mean);
+		__m128 squaredDifference = _mm_mul_ps(difference, difference);
+		__m128 deviationFloor = _mm_add_ps(minimalDeviation, _mm_mul_ps(minimalRelativeDeviation, mean));
+		__m128 flooredVariance = _mm_max_ps(variance, _mm_mul_ps(deviationFloor, deviationFloor));
+		__m128 outlier = _mm_cmpgt_ps(squaredDifference, _mm_mul_ps(squaredDeviations, flooredVariance));
+		__m128 closer = _mm_cmplt_ps(difference, zero);
+		__m128 foreground = _mm_and_ps(_mm_and_ps(valid, known), _mm_and_ps(outlier, closer));
+
+		__m128 rate = _mm_or_ps(_mm_and_ps(foreground, foregroundRate), _mm_andnot_ps(foreground, backgroundRate));
+		__m128 updatedMean = _mm_add_ps(mean, _mm_mul_ps(rate, difference));
+		__m128 updatedVariance = _mm_add_ps(variance, _mm_mul_ps(rate, _mm_sub_ps(squaredDifference, variance)));
+
+		// the first valid depth of a pixel starts its model, and invalid depth leaves the model as it is
+		updatedMean = _mm_or_ps(_mm_and_ps(known, updatedMean), _mm_andnot_ps(known, depth));
+		updatedVariance = _mm_or_ps(_mm_and_ps(known, updatedVariance), _mm_andnot_ps(known, initialVariance));
+		_mm_storeu_ps(meanPointer, _mm_or_ps(_mm_and_ps(valid, updatedMean), _mm_andnot_ps(valid, mean)));
+		_mm_storeu_ps(variancePointer, _mm_or_ps(_mm_and_ps(valid, updatedVariance), _mm_andnot_ps(valid, variance)));
+
+		return foreground;
+	}
+
+	void DepthBackgroundModel::UpdateRow(const unsigned short* depth, float* mean, float* variance, unsigned char* foreground, int width)
+	{
+		const __m128i zero = _mm_setzero_si128();
+
+		int col = 0;
+		for (; col + 8 <= width; col += 8)
+		{
+			__m128i depth16 = _mm_loadu_si128((const __m128i*)(depth + col));
+			__m128 lowDepth = _mm_cvtepi32_ps(_mm_unpacklo_epi16(depth16, zero));
+			__m128 highDepth = _mm_cvtepi32_ps(_mm_unpackhi_epi16(depth16, zero));
+
+			__m128i lowForeground = _mm_castps_si128(UpdatePixels(lowDepth, mean + col, variance + col));
+			__m128i highForeground = _mm_castps_si128(UpdatePixels(highDepth, mean + col + 4, variance + col + 4));
+
+			// all ones (-1) saturates to all ones at every narrowing, so the eight masks end up as eight 0xFF / 0x00 bytes
+			__m128i foreground8 = _mm_packs_epi16(_mm_packs_epi32(lowForeground, highForeground), zero);
+			_mm_storel_epi64((__m128i*)(foreground + col), foreground8);
+		}
+
+		for (; col < width; col += 4) // the tail, four at a time through a padded buffer (512 wide frames never get here)
+		{
+			int count = width - col < 4 ? width - col : 4;
+			float depthTail[4] = { 0 }, meanTail[4] = { 0 }, varianceTail[4] = { 0 };
+			for (int i = 0; i < count; i++)
+			{
+				depthTail[i] = depth[col + i];
+				meanTail[i] = mean[col + i];
+				varianceTail[i] = variance[col + i];
+			}
+
+			int foregroundTail = _mm_movemask_ps(UpdatePixels(_mm_loadu_ps(depthTail), meanTail, varianceTail));
+			for (int i = 0; i < count; i++)
+			{
+				mean[col + i] = meanTail[i];
+				variance[col + i] = varianceTail[i];
+				foreground[col + i] = (foregroundTail >> i) & 1 ? 255 : 0;
+			}
+		}
+	}
+
+	void DepthBackgroundModel::FindBoundingBoxes()
+	{
+		static const cv::Mat kernel = cv::getStructuringElement(cv::MORPH_RECT, cv::Size(3, 3));
+		cv::morphologyEx(_foreground, _openedForeground, cv::MORPH_OPEN, kernel); // speckles along depth edges aren't objects
+
+		int labelCount = cv::connectedComponentsWithStats(_openedForeground, _labels, _stats, _centroids, 8, CV_32S);
+
+		_boundingBoxes.clear();
+		for (int label = 1; label < labelCount; label++) // 0 is the background
+		{
+			if (_stats.at<int>(label, cv::CC_STAT_AREA) < MinimalBlobArea) continue;
+			_boundingBoxes.push_back(cv::Rect(_stats.at<int>(label, cv::CC_STAT_LEFT), _stats.at<int>(label, cv::CC_STAT_TOP),
+				_stats.at<int>(label, cv::CC_STAT_WIDTH), _stats.at<int>(label, cv::CC_STAT_HEIGHT)));
+		}
+	}
+}
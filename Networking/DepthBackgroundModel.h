@@ -0,0 +1,36 @@
+#pragma once
+
+#include "ChannelProperties.h"
+#include <opencv2/core/core.hpp>
+#include <vector>
+
+namespace Networking
+{
+	// keeps a per-pixel running model of the static depth of a camera's scene, and marks what stands in front of it
+	// each pixel holds a running mean and variance of its depth. A valid pixel that is closer than the mean by more than
+	// ForegroundDeviations standard deviations is foreground. Background pixels update the model quickly, foreground ones very
+	// slowly, so an object that stops moving is absorbed into the background after a while. Invalid (zero) depth never updates
+	// the model and is never foreground - the Kinect reports zero on edges, dark or shiny surfaces and out of range.
+	// The per-pixel update is vectorised with SSE2, eight pixels per iteration.
+	class DepthBackgroundModel
+	{
+		cv::Mat _mean; // [mm], CV_32FC1, zero where no valid depth was seen yet
+		cv::Mat _variance; // [mm^2], CV_32FC1
+		cv::Mat _foreground; // CV_8UC1, 255 - foreground, per pixel
+		cv::Mat _openedForeground; // _foreground without the speckles (a morphological opening) - what the blobs are found in
+		cv::Mat _labels, _stats, _centroids; // kept to avoid reallocation every frame
+		std::vector<cv::Rect> _boundingBoxes;
+
+	public:
+		DepthBackgroundModel(const ChannelProperties* channelProperties);
+
+		void Update(const cv::Mat& depth); // depth in mm, as NetworkPacketProcessor returns it
+
+		const cv::Mat& ForegroundMask() const { return _openedForeground; } // of the last update, the one BoundingBoxes were found in
+		const std::vector<cv::Rect>& BoundingBoxes() const { return _boundingBoxes; } // of the foreground blobs large enough to matter
+
+	private:
+		void UpdateRow(const unsigned short* depth, float* mean, float* variance, unsigned char* foreground, int width);
+		void FindBoundingBoxes();
+	};
+}
@@ -0,0 +1,148 @@
+#include "DepthQualityStatistics.h"
+#include <emmintrin.h> // SSE2
+#include <stdio.h>
+
+namespace Networking
+{
+	const unsigned char IrSaturation = 255; // the IR stream is 8 bit, so saturated pixels are the ones at full scale
+
+	DepthQualityStatistics::DepthQualityStatistics(const ChannelProperties* channelProperties, int rowStride) : _channelType(channelProperties->ChannelType), _rowStride(rowStride)
+	{
+		if (_channelType != ChannelType::Depth && _channelType != ChannelType::Ir) throw std::runtime_error("Quality statistics need a depth or an IR channel");
+		if (_rowStride < 1) throw std::runtime_error("The row stride of the quality statistics has to be positive");
+
+		_thresholds[0] = 1;
+		for (int bin = 1; bin <= DepthHistogramBins; bin++)
+			_thresholds[bin] = (unsigned short)(bin * channelProperties->DepthExpectedMax / DepthHistogramBins + 0.5f);
+
+		Reset();
+	}
+
+	void DepthQualityStatistics::Reset()
+	{
+		_frames = 0;
+		_pixels = 0;
+		for (int bin = 0; bin <= DepthHistogramBins; bin++) _atLeast[bin] = 0;
+		_saturated = 0;
+		_time = 0;
+		_lastUpdateTime = 0;
+		_forcedDecodes = 0;
+		_forcedDecodeTime = 0;
+	}
+
+	void DepthQualityStatistics::Update(const cv::Mat& frame)
+	{
+		int64 start = cv::getTickCount();
+
+		if (_channelType == ChannelType::Depth)
+		{
+			CV_Assert(frame.type() == CV_16UC1);
+			for (int row = 0; row < frame.rows; row += _rowStride) UpdateDepthRow(frame.ptr<unsigned short>(row), frame.cols);
+		}
+		else
+		{
+			CV_Assert(frame.type() == CV_8UC1);
+			for (int row = 0; row < frame.rows; row += _rowStride) UpdateIrRow(frame.ptr<unsigned char>(row), frame.cols);
+		}
+
+		_lastUpdateTime = 1000. * (cv::getTickCount() - start) / cv::getTickFrequency();
+		_time += _lastUpdateTime;
+		_frames++;
+	}
+
+	void DepthQualityStatistics::AddForcedDecode(float decodeTime)
+	{
+		_forcedDecodes++;
+		if (decodeTime > _lastUpdateTime) _forcedDecodeTime += decodeTime - _lastUpdateTime; // Update is in _time already
+	}
+
+	void DepthQualityStatistics::UpdateDepthRow(const unsigned short* depth, int width)
+	{
+		const __m128i zero = _mm_setzero_si128();
+		__m128i thresholds[DepthHistogramBins + 1];
+		__m128i counts[DepthHistogramBins + 1]; // eight 16 bit counts per threshold - a lane sees width / 8 pixels of the row, far from overflowing
+		for (int bin = 0; bin <= DepthHistogramBins; bin++)
+		{
+			thresholds[bin] = _mm_set1_epi16((short)_thresholds[bin]);
+			counts[bin] = zero;
+		}
+
+		int col = 0;
+		for (; col + 8 <= width; col += 8)
+		{
+			__m128i depth16 = _mm_loadu_si128((const __m128i*)(depth + col));
+			for (int bin = 0; bin <= DepthHistogramBins; bin++) // SSE2 has no unsigned compare - depth is at or beyond the threshold where threshold - depth saturates to zero
+				counts[bin] = _mm_sub_epi16(counts[bin], _mm_cmpeq_epi16(_mm_subs_epu16(thresholds[bin], depth16), zero)); // a true compare is -1
+		}
+
+		const __m128i ones = _mm_set1_epi16(1);
+		for (int bin = 0; bin <= DepthHistogramBins; bin++)
+		{
+			__m128i sums = _mm_madd_epi16(counts[bin], ones); // four 32 bit sums of pairs
+			sums = _mm_add_epi32(sums, _mm_srli_si128(sums, 8));
+			sums = _mm_add_epi32(sums, _mm_srli_si128(sums, 4));
+			_atLeast[bin] += _mm_cvtsi128_si32(sums);
+
+			for (int tail = col; tail < width; tail++) _atLeast[bin] += depth[tail] >= _thresholds[bin]; // 512 wide frames have no tail
+		}
+
+		_pixels += width;
+	}
+
+	void DepthQualityStatistics::UpdateIrRow(const unsigned char* ir, int width)
+	{
+		const __m128i zero = _mm_setzero_si128();
+		const __m128i ones = _mm_set1_epi8(1);
+		const __m128i saturation = _mm_set1_epi8((char)IrSaturation);
+		__m128i sums = zero; // two 64 bit sums
+
+		int col = 0;
+		for (; col + 16 <= width; col += 16)
+		{
+			__m128i ir8 = _mm_loadu_si128((const __m128i*)(ir + col));
+			sums = _mm_add_epi64(sums, _mm_sad_epu8(_mm_and_si128(_mm_cmpeq_epi8(ir8, saturation), ones), zero)); // adds up the sixteen 0 / 1 bytes
+		}
+
+		_saturated += _mm_cvtsi128_si32(sums) + _mm_cvtsi128_si32(_mm_srli_si128(sums, 8));
+		for (; col < width; col++) _saturated += ir[col] == IrSaturation;
+
+		_pixels += width;
+	}
+
+	double DepthQualityStatistics::InvalidFraction() const
+	{
+		return _pixels > 0 ? (double)(_pixels - _atLeast[0]) / _pixels : 0;
+	}
+
+	double DepthQualityStatistics::RangeFraction(int bin) const
+	{
+		if (_atLeast[0] == 0) return 0;
+		unsigned long long inBin = bin < DepthHistogramBins ? _atLeast[bin] - _atLeast[bin + 1] : _atLeast[bin];
+		return (double)inBin / _atLeast[0];
+	}
+
+	double DepthQualityStatistics::SaturatedFraction() const
+	{
+		return _pixels > 0 ? (double)_saturated / _pixels : 0;
+	}
+
+	std::string DepthQualityStatistics::ToString() const
+	{
+		char description[512];
+		int length = sprintf_s(description, "%d frame(s), %d decoded only for the statistics, 1/%d of the rows sampled, %2.2f [ms] per frame - ",
+			_frames, _forcedDecodes, _rowStride, TimePerFrame());
+
+		if (_channelType == ChannelType::Ir)
+		{
+			sprintf_s(description + length, sizeof(description) - length, "%2.2f%% saturated", 100 * SaturatedFraction());
+			return description;
+		}
+
+		length += sprintf_s(description + length, sizeof(description) - length, "%2.1f%% invalid, valid ranges [mm]:", 100 * InvalidFraction());
+		for (int bin = 0; bin < DepthHistogramBins; bin++)
+			length += sprintf_s(description + length, sizeof(description) - length, " %d-%d %2.1f%%,", bin == 0 ? 0 : _thresholds[bin], _thresholds[bin + 1], 100 * RangeFraction(bin));
+		sprintf_s(description + length, sizeof(description) - length, " beyond %d %2.1f%%", _thresholds[DepthHistogramBins], 100 * RangeFraction(DepthHistogramBins));
+
+		return description;
+	}
+}
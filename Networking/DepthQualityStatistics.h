@@ -0,0 +1,49 @@
+#pragma once
+
+#include "ChannelProperties.h"
+#include <opencv2/core/core.hpp>
+#include <string>
+
+namespace Networking
+{
+	const int DepthHistogramBins = 8; // over [0, DepthExpectedMax), plus one for whatever lies beyond
+
+	// cheap per-frame statistics of the depth sensor's output, which sunlight and multipath degrade long before it shows in a reconstruction:
+	// for depth - the fraction of invalid (zero) pixels and a histogram of the valid ranges, binned against DepthExpectedMax;
+	// for IR - the fraction of saturated pixels. Gathered by NetworkPacketProcessor as it decodes a frame, over every rowStride-th row,
+	// and accumulated until Reset, so a report covers a telemetry window. Vectorised with SSE2, sixteen IR or eight depth pixels per iteration.
+	// Frames decoded only for the statistics are reported with AddForcedDecode, so their decoding counts in the cost (TimePerFrame).
+	class DepthQualityStatistics
+	{
+		enum ChannelType _channelType;
+		int _rowStride;
+		unsigned short _thresholds[DepthHistogramBins + 1]; // [mm], lower bound of each bin - the first one is 1, so invalid pixels fall below all of them
+
+		unsigned int _frames;
+		unsigned long long _pixels; // sampled
+		unsigned long long _atLeast[DepthHistogramBins + 1]; // depth - pixels at or beyond each threshold
+		unsigned long long _saturated; // IR
+		double _time; // [ms], spent in Update
+		double _lastUpdateTime; // [ms]
+		unsigned int _forcedDecodes;
+		double _forcedDecodeTime; // [ms], Update excluded
+
+	public:
+		DepthQualityStatistics(const ChannelProperties* channelProperties, int rowStride = 1); // rowStride > 1 - samples every rowStride-th row only
+
+		void Update(const cv::Mat& frame); // depth in mm, or IR, as NetworkPacketProcessor returns them
+		void AddForcedDecode(float decodeTime); // [ms], of a frame decoded only for the statistics (Update included), right after its Update
+		void Reset();
+
+		unsigned int Frames() const { return _frames; }
+		double InvalidFraction() const; // depth
+		double RangeFraction(int bin) const; // depth, of the valid pixels; bin DepthHistogramBins - beyond DepthExpectedMax
+		double SaturatedFraction() const; // IR
+		double TimePerFrame() const { return _frames > 0 ? (_time + _forcedDecodeTime) / _frames : 0; } // [ms], forced decodes included
+		std::string ToString() const;
+
+	private:
+		void UpdateDepthRow(const unsigned short* depth, int width);
+		void UpdateIrRow(const unsigned char* ir, int width);
+	};
+}
@@ -0,0 +1,48 @@
+#pragma once
+
+#include <string>
+
+namespace Networking
+{
+	// memory layout of the shared-memory frame ring published by the client for each camera (see FrameBusPublisher / FrameBusSubscriber)
+	// a FrameBusHeader is followed by SlotCount slots, each a FrameBusSlotHeader followed by SlotCapacity bytes of frame data.
+	// There is a single writer per ring. Every slot is protected by a sequence lock: while frame n is being written into slot
+	// n % SlotCount, the slot's Sequence is 2n - 1 (odd), and once it is complete it is 2n. A reader that sees the same even
+	// Sequence before and after reading the data knows the data wasn't overwritten in the meantime - readers never block the writer.
+
+	const unsigned int FrameBusMagic = 0x4B324642; // "K2FB"
+	const unsigned int FrameBusVersion = 1;
+	const unsigned int FrameBusSlotCount = 8; // ~260 ms at 30 Hz before a published frame is overwritten
+	const unsigned int FrameBusAlignment = 64; // a cache line
+
+	struct FrameBusHeader
+	{
+		unsigned int Magic;
+		unsigned int Version;
+		unsigned int SlotCount;
+		unsigned int SlotCapacity; // [bytes] of frame data per slot
+		unsigned int SlotStride; // [bytes] from the start of one slot header to the next
+		unsigned int Reserved;
+		volatile long long LatestFrame; // number of the most recently completed frame (frames are numbered from 1, 0 means none yet)
+	};
+
+	struct FrameBusSlotHeader
+	{
+		volatile long long Sequence;
+		unsigned long long FrameNumber;
+		long TimestampSeconds;
+		long TimestampMilliseconds;
+		int ChannelType;
+		int Width;
+		int Height;
+		int PixelType; // OpenCV type of the decoded pixels
+		unsigned int Compressed; // 1 - the data is the compressed packet as received (JPEG/PNG), 0 - decoded pixels, row after row
+		unsigned int DataSize; // [bytes]
+	};
+
+	inline unsigned int FrameBusAlign(unsigned int size) { return (size + FrameBusAlignment - 1) / FrameBusAlignment * FrameBusAlignment; }
+	inline unsigned int FrameBusSlotDataOffset() { return FrameBusAlign(sizeof(FrameBusSlotHeader)); }
+	inline unsigned int FrameBusSlotsOffset() { return FrameBusAlign(sizeof(FrameBusHeader)); }
+
+	inline std::string FrameBusName(unsigned int cameraIndex) { return "Local\\Kinect2FrameBus_Camera_" + std::to_string(cameraIndex); }
+}
@@ -0,0 +1,99 @@
+#include "FrameBusPublisher.h"
+
+#include <stdexcept>
+
+namespace Networking
+{
+	FrameBusPublisher::FrameBusPublisher(unsigned int cameraIndex, const ChannelProperties* channelProperties) : _mapping(NULL), _view(NULL), _header(NULL), _frameNumber(0)
+	{
+		unsigned int slotCapacity = FrameBusAlign(channelProperties->Width * channelProperties->Height * channelProperties->PixelSize);
+		unsigned int slotStride = FrameBusSlotDataOffset() + slotCapacity;
+		unsigned long long size = FrameBusSlotsOffset() + (unsigned long long)slotStride * FrameBusSlotCount;
+
+		std::string name = FrameBusName(cameraIndex);
+		_mapping = CreateFileMappingA(INVALID_HANDLE_VALUE, NULL, PAGE_READWRITE, (DWORD)(size >> 32), (DWORD)(size & 0xFFFFFFFF), name.c_str());
+		if (!_mapping) throw std::runtime_error("Failed to create shared memory " + name + ": " + std::to_string(GetLastError()));
+
+		_view = (unsigned char*)MapViewOfFile(_mapping, FILE_MAP_ALL_ACCESS, 0, 0, (SIZE_T)size);
+		if (!_view)
+		{
+			CloseHandle(_mapping);
+			throw std::runtime_error("Failed to map shared memory " + name + ": " + std::to_string(GetLastError()));
+		}
+
+		// a ring left behind by a previous run of the client is simply reset - subscribers notice the frame numbers starting over
+		ZeroMemory(_view, (SIZE_T)size);
+		_header = (FrameBusHeader*)_view;
+		_header->SlotCount = FrameBusSlotCount;
+		_header->SlotCapacity = slotCapacity;
+		_header->SlotStride = slotStride;
+		_header->Version = FrameBusVersion;
+		MemoryBarrier();
+		_header->Magic = FrameBusMagic; // last, so that a subscriber never sees a half initialized header
+	}
+
+	FrameBusPublisher::~FrameBusPublisher()
+	{
+		if (_view) UnmapViewOfFile(_view);
+		if (_mapping) CloseHandle(_mapping);
+	}
+
+	void FrameBusPublisher::PublishFrame(const cv::Mat& frame, Timestamp timestamp, const ChannelProperties* channelProperties)
+	{
+		unsigned int dataSize = (unsigned int)(frame.total() * frame.elemSize());
+		if (dataSize > _header->SlotCapacity) throw std::runtime_error("Frame is too large for the frame bus");
+
+		FrameBusSlotHeader* slot = BeginWrite();
+
+		slot->TimestampSeconds = timestamp.Seconds;
+		slot->TimestampMilliseconds = timestamp.Milliseconds;
+		slot->ChannelType = channelProperties->ChannelType;
+		slot->Width = frame.cols;
+		slot->Height = frame.rows;
+		slot->PixelType = frame.type();
+		slot->Compressed = 0;
+		slot->DataSize = dataSize;
+
+		cv::Mat slotPixels(frame.rows, frame.cols, frame.type(), (unsigned char*)slot + FrameBusSlotDataOffset());
+		frame.copyTo(slotPixels); // the only copy - every subscriber reads straight out of the slot
+
+		EndWrite(slot);
+	}
+
+	void FrameBusPublisher::PublishPacket(const NetworkPacket& packet, const ChannelProperties* channelProperties)
+	{
+		if (packet.Data.size() > _header->SlotCapacity) throw std::runtime_error("Packet is too large for the frame bus");
+
+		FrameBusSlotHeader* slot = BeginWrite();
+
+		slot->TimestampSeconds = packet.Timestamp.Seconds;
+		slot->TimestampMilliseconds = packet.Timestamp.Milliseconds;
+		slot->ChannelType = channelProperties->ChannelType;
+		slot->Width = channelProperties->Width;
+		slot->Height = channelProperties->Height;
+		slot->PixelType = channelProperties->PixelType;
+		slot->Compressed = 1;
+		slot->DataSize = (unsigned int)packet.Data.size();
+
+		memcpy((unsigned char*)slot + FrameBusSlotDataOffset(), packet.Data.data(), packet.Data.size());
+
+		EndWrite(slot);
+	}
+
+	FrameBusSlotHeader* FrameBusPublisher::BeginWrite()
+	{
+		_frameNumber++;
+		FrameBusSlotHeader* slot = (FrameBusSlotHeader*)(_view + FrameBusSlotsOffset() + (_frameNumber % _header->SlotCount) * _header->SlotStride);
+
+		InterlockedExchange64(&slot->Sequence, 2 * _frameNumber - 1); // odd - readers of the previous frame in this slot will notice
+		slot->FrameNumber = _frameNumber;
+
+		return slot;
+	}
+
+	void FrameBusPublisher::EndWrite(FrameBusSlotHeader* slot)
+	{
+		InterlockedExchange64(&slot->Sequence, 2 * _frameNumber); // full barrier - the data is visible before the sequence
+		InterlockedExchange64(&_header->LatestFrame, _frameNumber);
+	}
+}
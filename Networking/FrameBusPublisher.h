@@ -0,0 +1,29 @@
+#pragma once
+
+#include "PacketClient.h"
+#include "FrameBusLayout.h"
+#include <opencv2/core/core.hpp>
+
+namespace Networking
+{
+	// publishes the frames of a single camera into a shared-memory ring, from which any number of local processes can read
+	// them without copies or decoding of their own (see FrameBusSubscriber). Must only be used from one thread.
+	class FrameBusPublisher
+	{
+		HANDLE _mapping;
+		unsigned char* _view;
+		FrameBusHeader* _header;
+		long long _frameNumber;
+
+	public:
+		FrameBusPublisher(unsigned int cameraIndex, const ChannelProperties* channelProperties); // sized for a full decoded frame (a compressed one is never larger)
+		~FrameBusPublisher();
+
+		void PublishFrame(const cv::Mat& frame, Timestamp timestamp, const ChannelProperties* channelProperties); // decoded pixels
+		void PublishPacket(const NetworkPacket& packet, const ChannelProperties* channelProperties); // compressed, as received
+
+	private:
+		FrameBusSlotHeader* BeginWrite(); // marks the next slot as being written and returns it
+		void EndWrite(FrameBusSlotHeader* slot); // marks the slot as complete and announces it
+	};
+}
@@ -0,0 +1,97 @@
+#include "FrameBusSubscriber.h"
+
+#include <stdexcept>
+
+namespace Networking
+{
+	FrameBusSubscriber::FrameBusSubscriber(unsigned int cameraIndex) : _mapping(NULL), _view(NULL), _header(NULL), _lastFrame(0), _missedFrames(0)
+	{
+		std::string name = FrameBusName(cameraIndex);
+		_mapping = OpenFileMappingA(FILE_MAP_READ, FALSE, name.c_str());
+		if (!_mapping) throw std::runtime_error("No frame bus " + name + " - is the client running with -bus?");
+
+		_view = (unsigned char*)MapViewOfFile(_mapping, FILE_MAP_READ, 0, 0, 0);
+		if (!_view)
+		{
+			CloseHandle(_mapping);
+			throw std::runtime_error("Failed to map shared memory " + name + ": " + std::to_string(GetLastError()));
+		}
+
+		_header = (const FrameBusHeader*)_view;
+		if (_header->Magic != FrameBusMagic || _header->Version != FrameBusVersion)
+		{
+			UnmapViewOfFile(_view);
+			CloseHandle(_mapping);
+			throw std::runtime_error("Frame bus " + name + " isn't initialized or has an incompatible version");
+		}
+	}
+
+	FrameBusSubscriber::~FrameBusSubscriber()
+	{
+		if (_view) UnmapViewOfFile(_view);
+		if (_mapping) CloseHandle(_mapping);
+	}
+
+	const FrameBusSlotHeader* FrameBusSubscriber::Slot(long long frameNumber) const
+	{
+		return (const FrameBusSlotHeader*)(_view + FrameBusSlotsOffset() + (frameNumber % _header->SlotCount) * _header->SlotStride);
+	}
+
+	bool FrameBusSubscriber::NextFrame(FrameBusView& frame, DWORD timeout)
+	{
+		DWORD start = GetTickCount();
+		while (true)
+		{
+			long long latest = _header->LatestFrame;
+			if (latest < _lastFrame) _lastFrame = 0; // the client was restarted and the frame numbers started over
+
+			if (latest > _lastFrame && TryReadLatest(frame))
+			{
+				if (_lastFrame) _missedFrames += frame.FrameNumber - _lastFrame - 1;
+				_lastFrame = frame.FrameNumber;
+				return true;
+			}
+
+			if (GetTickCount() - start >= timeout) return false;
+			Sleep(1); // a frame arrives every ~33 ms, polling is cheap and keeps the publisher free of any signalling
+		}
+	}
+
+	bool FrameBusSubscriber::TryReadLatest(FrameBusView& frame)
+	{
+		long long frameNumber = _header->LatestFrame;
+		const FrameBusSlotHeader* slot = Slot(frameNumber);
+
+		long long sequence = slot->Sequence;
+		MemoryBarrier(); // read the sequence before the contents
+		if (sequence != 2 * frameNumber) return false; // already being overwritten by a newer frame - try again with that one
+
+		frame.FrameNumber = frameNumber;
+		frame.Timestamp.Seconds = slot->TimestampSeconds;
+		frame.Timestamp.Milliseconds = slot->TimestampMilliseconds;
+		frame.ChannelType = (enum ChannelType)slot->ChannelType;
+		frame.Compressed = slot->Compressed != 0;
+		frame.Data = (const unsigned char*)slot + FrameBusSlotDataOffset();
+		frame.DataSize = slot->DataSize;
+		frame.Pixels = frame.Compressed ? cv::Mat() : cv::Mat(slot->Height, slot->Width, slot->PixelType, (void*)frame.Data);
+		frame.Sequence = sequence;
+
+		return IsStillValid(frame); // the header fields themselves must not be torn
+	}
+
+	bool FrameBusSubscriber::IsStillValid(const FrameBusView& frame) const
+	{
+		MemoryBarrier(); // finish reading the contents before checking the sequence
+		return Slot(frame.FrameNumber)->Sequence == frame.Sequence;
+	}
+
+	bool FrameBusSubscriber::CopyFrame(const FrameBusView& frame, cv::Mat& copy) const
+	{
+		if (frame.Compressed)
+			cv::Mat(1, frame.DataSize, CV_8UC1, (void*)frame.Data).copyTo(copy);
+		else
+			frame.Pixels.copyTo(copy);
+
+		return IsStillValid(frame);
+	}
+}
@@ -0,0 +1,47 @@
+#pragma once
+
+#include "PacketClient.h"
+#include "FrameBusLayout.h"
+#include <opencv2/core/core.hpp>
+
+namespace Networking
+{
+	// a frame read from the frame bus - the data points straight into shared memory, so it is only valid until the publisher
+	// comes around the ring again; check FrameBusSubscriber::IsStillValid after using it (or copy it first)
+	struct FrameBusView
+	{
+		long long FrameNumber;
+		Timestamp Timestamp;
+		enum ChannelType ChannelType;
+		bool Compressed; // the data is the JPEG/PNG packet as the server sent it
+		const unsigned char* Data;
+		unsigned int DataSize;
+		cv::Mat Pixels; // decoded frames only - a header over Data, no copy
+
+		long long Sequence; // of the slot when the view was taken
+	};
+
+	// reads the frames a client publishes for one camera (see FrameBusPublisher) from another process on the same machine
+	class FrameBusSubscriber
+	{
+		HANDLE _mapping;
+		unsigned char* _view;
+		const FrameBusHeader* _header;
+		long long _lastFrame;
+		long long _missedFrames;
+
+	public:
+		FrameBusSubscriber(unsigned int cameraIndex); // throws if the client isn't publishing this camera
+		~FrameBusSubscriber();
+
+		bool NextFrame(FrameBusView& frame, DWORD timeout); // waits for a frame newer than the previous one, returns false on timeout
+		bool IsStillValid(const FrameBusView& frame) const; // true if the frame wasn't overwritten while it was being used
+		bool CopyFrame(const FrameBusView& frame, cv::Mat& copy) const; // a copy that stays valid, false if the frame was already overwritten
+
+		long long MissedFrames() const { return _missedFrames; } // frames published but never returned by NextFrame (the subscriber was too slow)
+
+	private:
+		const FrameBusSlotHeader* Slot(long long frameNumber) const;
+		bool TryReadLatest(FrameBusView& frame);
+	};
+}
@@ -0,0 +1,50 @@
+#include "LazyFrame.h"
+
+namespace Networking
+{
+	void LazyFrame::SetPacket(const NetworkPacket* packet, bool samePixels)
+	{
+		_packet = packet;
+		_decoded = _decoded && samePixels; // the processor (and the undistortion) write into the same buffer every time, so the previous pixels are still there
+		_undistorted = _undistorted && _decoded;
+		_decodeTime = 0;
+		_frames++;
+
+		if (_processor->DecodesEveryPacket()) Decode(); // a video decoder can't skip packets - its next picture depends on this one
+	}
+
+	const cv::Mat& LazyFrame::Pixels()
+	{
+		if (!_decoded) Decode();
+		if (!_undistortion) return _pixels;
+
+		if (!_undistorted)
+		{
+			LARGE_INTEGER frequency, start, end;
+			QueryPerformanceFrequency(&frequency);
+			QueryPerformanceCounter(&start);
+
+			_undistortedPixels = _undistortion->Apply(_pixels);
+
+			QueryPerformanceCounter(&end);
+			_decodeTime += 1000.f * (end.QuadPart - start.QuadPart) / frequency.QuadPart;
+			_undistorted = true;
+		}
+
+		return _undistortedPixels;
+	}
+
+	void LazyFrame::Decode()
+	{
+		LARGE_INTEGER frequency, start, end;
+		QueryPerformanceFrequency(&frequency);
+		QueryPerformanceCounter(&start);
+
+		_pixels = _processor->ProcessPacket(*_packet);
+
+		QueryPerformanceCounter(&end);
+		_decodeTime = 1000.f * (end.QuadPart - start.QuadPart) / frequency.QuadPart;
+		_decoded = true;
+		_decodedFrames++;
+	}
+}
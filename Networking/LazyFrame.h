@@ -0,0 +1,41 @@
+#pragma once
+
+#include "NetworkPacketProcessor.h"
+#include "UndistortionStage.h"
+
+namespace Networking
+{
+	// a received frame that is decoded only when some consumer asks for its pixels - and then only once, however many consumers ask
+	// headless runs, or recorders that only save every so many frames, skip most of the decoding this way (not so for video streams,
+	// which are decoded as soon as they arrive - every picture depends on the previous ones).
+	// Holds on to the packet it was given (not a copy), so the packet must outlive the frame's current use.
+	// With an undistortion stage, the pixels consumers get are undistorted - also only on demand, even for video streams.
+	class LazyFrame
+	{
+		NetworkPacketProcessor* _processor; // not managed
+		UndistortionStage* _undistortion; // not managed, may be NULL
+		const NetworkPacket* _packet; // not managed
+		cv::Mat _pixels; // as decoded
+		cv::Mat _undistortedPixels;
+		bool _decoded;
+		bool _undistorted;
+		float _decodeTime; // [ms], of the current packet, undistortion included - zero if it wasn't decoded
+		unsigned int _decodedFrames;
+		unsigned int _frames;
+
+	public:
+		LazyFrame(NetworkPacketProcessor* processor, UndistortionStage* undistortion = NULL) : _processor(processor), _undistortion(undistortion), _packet(NULL), _decoded(false), _undistorted(false), _decodeTime(0), _decodedFrames(0), _frames(0) {}
+
+		// samePixels - the payload is identical to that of the previous packet, so its pixels (if decoded) still hold
+		void SetPacket(const NetworkPacket* packet, bool samePixels);
+
+		const cv::Mat& Pixels(); // decodes the packet on first access
+		void Decode(); // decodes the packet now, without the undistortion - for what the processor gathers while decoding (see IsDecoded)
+		bool IsDecoded() const { return _decoded; }
+		const NetworkPacket& Packet() const { return *_packet; }
+
+		float DecodeTime() const { return _decodeTime; }
+		unsigned int DecodedFrames() const { return _decodedFrames; }
+		unsigned int Frames() const { return _frames; }
+	};
+}
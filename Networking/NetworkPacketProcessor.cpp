@@ -1,15 +1,22 @@
 #include "NetworkPacketProcessor.h"
+#include "ThreadPlacement.h"
+#include <opencv2/imgproc/imgproc.hpp>
 
 namespace Networking
 {
-	NetworkPacketProcessor::NetworkPacketProcessor(const ChannelProperties* channelProperties) : _channelProperties(channelProperties), _imageData(NULL)
+	NetworkPacketProcessor::NetworkPacketProcessor(const ChannelProperties* channelProperties, int jpegDecodeBands) : _channelProperties(channelProperties), _imageData(NULL), _videoDecoder(NULL), _parallelJpegDecoder(NULL), _qualityStatistics(NULL)
 	{
-		_imageData = new uchar[_channelProperties->Width * _channelProperties->Height * _channelProperties->PixelSize];
+		_imageData = (uchar*)AllocateNodeLocal(_channelProperties->Width * _channelProperties->Height * _channelProperties->PixelSize); // on the node of the core decoding into it
+		if (_channelProperties->IsVideo()) _videoDecoder = new VideoDecoder(_channelProperties);
+		if (_channelProperties->ChannelType == ChannelType::Color) _parallelJpegDecoder = new ParallelJpegDecoder(jpegDecodeBands);
 	}
 
 	NetworkPacketProcessor::~NetworkPacketProcessor()
 	{
-		if (_imageData) delete[] _imageData;
+		if (_videoDecoder) delete _videoDecoder;
+		if (_parallelJpegDecoder) delete _parallelJpegDecoder;
+		if (_qualityStatistics) delete _qualityStatistics;
+		FreeNodeLocal(_imageData);
 	}
 
 	cv::Mat NetworkPacketProcessor::ProcessPacket(NetworkPacket packet)
@@ -27,20 +34,32 @@ namespace Networking
 		case ChannelType::Ir:    
 			currentFrameMat = ProcessPngPacket(packet);
 			break;
+		case ChannelType::ColorH264:
+		case ChannelType::ColorHevc:
+			currentFrameMat = ProcessVideoPacket(packet);
+			break;
 		default:				 
 			throw std::runtime_error("Could not identify packet type");
 		};
 
 		assert(currentFrameMat.cols == _channelProperties->Width && currentFrameMat.rows == _channelProperties->Height && currentFrameMat.elemSize() == _channelProperties->PixelSize);
+		if (_qualityStatistics) _qualityStatistics->Update(currentFrameMat);
 		return currentFrameMat;
 	}
 
+	void NetworkPacketProcessor::CollectQualityStatistics(int rowStride)
+	{
+		if (_qualityStatistics || (_channelProperties->ChannelType != ChannelType::Depth && _channelProperties->ChannelType != ChannelType::Ir)) return;
+		_qualityStatistics = new DepthQualityStatistics(_channelProperties, rowStride);
+	}
+
 	cv::Mat NetworkPacketProcessor::ProcessJpegPacket(NetworkPacket packet)
 	{		
 		cv::Mat currentFrameMat(_channelProperties->Height, _channelProperties->Width, _channelProperties->PixelType, _imageData);
-		imdecode(packet.Data, CV_LOAD_IMAGE_ANYCOLOR, &currentFrameMat); // how does openCV know that receivedJpeg contains a compressed Jpeg image ? by its content.
+		if (!_parallelJpegDecoder->Decode(packet.Data, currentFrameMat)) // restart markers or bands sent separately
+			imdecode(packet.Data, CV_LOAD_IMAGE_ANYCOLOR, &currentFrameMat); // how does openCV know that receivedJpeg contains a compressed Jpeg image ? by its content.
 
-		return currentFrameMat;
+		return RestoreFullResolution(currentFrameMat, cv::INTER_LINEAR);
 	}
 
 	cv::Mat NetworkPacketProcessor::ProcessPngPacket(NetworkPacket packet)
@@ -48,6 +67,36 @@ namespace Networking
 		cv::Mat currentFrameMat(_channelProperties->Height, _channelProperties->Width, _channelProperties->PixelType, _imageData);
 		imdecode(packet.Data, CV_LOAD_IMAGE_ANYDEPTH, &currentFrameMat); // how does openCV know that receivedPNG contains a compressed PNG image ? by its content.
 
+		return RestoreFullResolution(currentFrameMat, cv::INTER_NEAREST); // nearest neighbour - interpolating depth would blend invalid (zero) pixels into valid ones
+	}
+
+	cv::Mat NetworkPacketProcessor::ProcessVideoPacket(NetworkPacket packet)
+	{
+		// until the first keyframe, and after a corrupt packet, this is the last picture decoded (black at first - the buffer starts zeroed)
+		cv::Mat currentFrameMat(_channelProperties->Height, _channelProperties->Width, _channelProperties->PixelType, _imageData);
+		_videoDecoder->Decode(packet.Data, &currentFrameMat); // scales reduced resolution streams back up on the way
+
+		return currentFrameMat;
+	}
+
+	void NetworkPacketProcessor::SkipPacket(const NetworkPacket& packet)
+	{
+		if (_videoDecoder) _videoDecoder->Decode(packet.Data, NULL); // keeps the references, skips the conversion
+	}
+
+	void NetworkPacketProcessor::StreamInterrupted()
+	{
+		if (_videoDecoder) _videoDecoder->Reset();
+	}
+
+	cv::Mat NetworkPacketProcessor::RestoreFullResolution(cv::Mat decodedFrame, int interpolation)
+	{
+		if (decodedFrame.data == _imageData) // imdecode only reallocates when the server sent a reduced resolution frame
+			return decodedFrame;
+
+		cv::Mat currentFrameMat(_channelProperties->Height, _channelProperties->Width, _channelProperties->PixelType, _imageData);
+		cv::resize(decodedFrame, currentFrameMat, currentFrameMat.size(), 0, 0, interpolation);
+
 		return currentFrameMat;
 	}
 }
\ No newline at end of file
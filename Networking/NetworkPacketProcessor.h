@@ -1,6 +1,9 @@
 #pragma once
 
 #include "PacketClient.h"
+#include "VideoDecoder.h"
+#include "ParallelJpegDecoder.h"
+#include "DepthQualityStatistics.h"
 #include <opencv2/highgui/highgui.hpp>
 
 namespace Networking
@@ -9,15 +12,31 @@ namespace Networking
 	{
 		const ChannelProperties* _channelProperties; // not managed
 		uchar* _imageData; // managed
+		VideoDecoder* _videoDecoder; // managed, video streams only
+		ParallelJpegDecoder* _parallelJpegDecoder; // managed, JPEG streams only
+		DepthQualityStatistics* _qualityStatistics; // managed, depth and IR streams only - NULL unless collected
 
 	public:
-		NetworkPacketProcessor(const ChannelProperties* channelProperties);
+		NetworkPacketProcessor(const ChannelProperties* channelProperties, int jpegDecodeBands = 1); // jpegDecodeBands > 1 - JPEG frames that can be split are decoded on several cores (see ParallelJpegDecoder)
 		~NetworkPacketProcessor();
 
 		cv::Mat ProcessPacket(NetworkPacket packet);
+
+		// video streams only make sense when every packet goes through the decoder, so a packet that is dropped (e.g. by the
+		// synchronization) still has to be handed over here. Does nothing for JPEG/PNG streams.
+		void SkipPacket(const NetworkPacket& packet);
+		bool DecodesEveryPacket() const { return _videoDecoder != NULL; }
+		void StreamInterrupted(); // after a reconnection - a video stream has to wait for the next keyframe
+		bool WaitingForKeyframe() const { return _videoDecoder && _videoDecoder->WaitingForKeyframe(); }
+
+		// gathers DepthQualityStatistics of every frame decoded from now on (every rowStride-th row); does nothing for color streams
+		void CollectQualityStatistics(int rowStride);
+		DepthQualityStatistics* QualityStatistics() { return _qualityStatistics; } // NULL unless collected
 		
 	private:
 		cv::Mat ProcessJpegPacket(NetworkPacket packet);
 		cv::Mat ProcessPngPacket(NetworkPacket packet);
+		cv::Mat ProcessVideoPacket(NetworkPacket packet);
+		cv::Mat RestoreFullResolution(cv::Mat decodedFrame, int interpolation); // scales up frames the server sent at a reduced resolution
 	};
 }
\ No newline at end of file
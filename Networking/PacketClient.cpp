@@ -1,4 +1,6 @@
 #include "PacketClient.h"
+#include "ThreadPlacement.h"
+#include "ClockModel.h"
 #include <stdexcept>
 
 namespace Networking
@@ -9,12 +11,13 @@ namespace Networking
 												  // The solution: the server should actually dictate the size of this field when the connection is
 												  // established. I'm too lazy + have no time to implement that.
 	const unsigned int BytesInMetadata = 1;
+	const unsigned int BytesBeforePayload = 2 * BytesInTimestampField + BytesInHeader;
 
 	PacketClient::~PacketClient()
 	{
 		if (_channelProperties) delete _channelProperties;
 
-		if (_networkBuffer) delete[] _networkBuffer;
+		FreeNodeLocal(_networkBuffer);
 	}
 
 	NetworkPacket PacketClient::ReceivePacket()
@@ -26,47 +29,121 @@ namespace Networking
 		}
 
 		NetworkPacket emptyPacket;
+		Timestamp timestamp;
+		unsigned int dataSize;
+
+		if (!ReceivePacketHeader(timestamp, dataSize)) return emptyPacket;
+
+		return ReceivePacketPayload(timestamp, dataSize);
+	}
+
+	NetworkPacket PacketClient::ReceiveLatestPacket()
+	{
+		if (_channelProperties == NULL)
+		{
+			ReceiveMetadataPacket();
+			AllocateBuffers();
+		}
 
+		NetworkPacket emptyPacket;
+		Timestamp timestamp;
+		unsigned int dataSize;
+
+		if (!ReceivePacketHeader(timestamp, dataSize)) return emptyPacket;
+
+		// if the socket already holds this packet's payload and the header of the next one, this packet is stale - read its payload
+		// into the network buffer just to get it out of the way (no copy into a packet, no decoding) and move on to the next one
+		while (PendingBytes() >= dataSize + BytesBeforePayload)
+		{
+			if (waitUntilReceived(_networkBuffer, dataSize) < (int)dataSize) return emptyPacket;
+			_skippedPackets++;
+
+			if (!ReceivePacketHeader(timestamp, dataSize)) return emptyPacket;
+		}
+
+		return ReceivePacketPayload(timestamp, dataSize);
+	}
+
+	bool PacketClient::ReceivePacketHeader(Timestamp& timestamp, unsigned int& dataSize)
+	{
 		// receive timestamp
 		if (BytesInTimestampField != sizeof(long)) throw std::runtime_error("Expecting " + std::to_string(BytesInTimestampField) + "bytes for seconds & milliseconds fields of the timestamp. Cant put that in a long.");
-		Timestamp timestamp;
+
+		_headerQueued = PendingBytes() >= BytesBeforePayload; // the client fell behind the stream (slow consumers), so the arrival time is only an upper bound
 
 		unsigned int totalReceived = waitUntilReceived((char*)&timestamp.Seconds, BytesInTimestampField);
-		if (totalReceived < BytesInTimestampField) return emptyPacket;
+		if (totalReceived < BytesInTimestampField) return false;
 		totalReceived = waitUntilReceived((char*)&timestamp.Milliseconds, BytesInTimestampField);
-		if (totalReceived < BytesInTimestampField) return emptyPacket;
+		if (totalReceived < BytesInTimestampField) return false;
 
 		// receive header
 		uchar header[BytesInHeader];
 		totalReceived = waitUntilReceived((char*)header, BytesInHeader);
 		if (totalReceived < BytesInHeader) // totalReceived will be less than BYTES_IN_HEADER only if server has closed connection
-			return emptyPacket;
+			return false;
+
+		_headerArrivalTime = ClockModel::Now();
 
-		unsigned int dataSize = header[0];
+		dataSize = header[0];
 		dataSize += header[1] << BitsInByte;
 		dataSize += header[2] << 2 * BitsInByte;
 
 		if (dataSize > _maximalPacketSize)
 			throw std::runtime_error("Failed to receive packet - data size is too large");
 
+		return true;
+	}
+
+	NetworkPacket PacketClient::ReceivePacketPayload(Timestamp timestamp, unsigned int dataSize)
+	{
+		NetworkPacket emptyPacket;
+
 		// receive data
-		totalReceived = waitUntilReceived(_networkBuffer, dataSize);
-		if (totalReceived < dataSize) // totalReceived will be less than BYTES_IN_HEASER only if server has closed connection
-			throw std::runtime_error("Failed to receive packet - data size is smaller than expected");
+		unsigned int totalReceived = waitUntilReceived(_networkBuffer, dataSize);
+		if (totalReceived < dataSize) // totalReceived will be less than dataSize only if server has closed connection in the middle of a packet
+			return emptyPacket;
 
-		NetworkPacket receivedPacket{ std::vector<unsigned char>(_networkBuffer, _networkBuffer + dataSize), timestamp };
+		NetworkPacket receivedPacket{ std::vector<unsigned char>(_networkBuffer, _networkBuffer + dataSize), timestamp, _headerArrivalTime, _headerQueued };
 
 		return receivedPacket;
 	}
 
+	bool PacketClient::SendControlMessage(const ControlMessage& message)
+	{
+		// finish the message the socket took only part of before - a message is never dropped halfway, or the server would lose step
+		if (!_unsentControlBytes.empty())
+		{
+			int sent = SendBufferWithoutBlocking(&_unsentControlBytes[0], (int)_unsentControlBytes.size());
+			if (sent < 0) return false;
+			_unsentControlBytes.erase(_unsentControlBytes.begin(), _unsentControlBytes.begin() + sent);
+			if (!_unsentControlBytes.empty()) return false;
+		}
+
+		uchar serialized[BytesInControlMessage];
+		message.Serialize(serialized);
+
+		int sent = SendBufferWithoutBlocking((char*)serialized, BytesInControlMessage);
+		if (sent > 0 && sent < (int)BytesInControlMessage) _unsentControlBytes.assign(serialized + sent, serialized + BytesInControlMessage);
+
+		return sent == (int)BytesInControlMessage;
+	}
+
 	const ChannelProperties* PacketClient::ReceiveMetadataPacket()
 	{
 		uchar metadata[BytesInMetadata];
 		int totalReceived = waitUntilReceived((char*)metadata, BytesInMetadata);
 		if (totalReceived < BytesInMetadata) // totalReceived will be less than BYTES_IN_HEADER only if server has closed connection
 			throw std::runtime_error("Failed to receive metadata packet - size is smaller than expected");	
+		_unsentControlBytes.clear(); // a new connection - the server starts reading control messages afresh
 		
-		if (_channelProperties) delete _channelProperties;
+		if (_channelProperties)
+		{
+			// after a reconnection the same object is handed out again, so processors and recorders holding it stay valid
+			if (_channelProperties->ChannelType == (enum ChannelType)metadata[0])
+				return _channelProperties;
+
+			throw std::runtime_error("Server changed its channel type from " + _channelProperties->ToString() + " after reconnecting");
+		}
 
 		_channelProperties = new ChannelProperties((enum ChannelType)metadata[0]);
 
@@ -77,9 +154,12 @@ namespace Networking
 	{
 		if (!_channelProperties) ReceiveMetadataPacket();
 
-		if (_networkBuffer) delete[] _networkBuffer;
+		unsigned int maximalPacketSize = _channelProperties->Width * _channelProperties->Height * _channelProperties->PixelSize;
+		if (_networkBuffer && maximalPacketSize == _maximalPacketSize) return; // warm buffer from a previous connection
+
+		FreeNodeLocal(_networkBuffer);
 
-		_maximalPacketSize = _channelProperties->Width * _channelProperties->Height * _channelProperties->PixelSize;
-		_networkBuffer = new char[_maximalPacketSize];
+		_maximalPacketSize = maximalPacketSize;
+		_networkBuffer = (char*)AllocateNodeLocal(_maximalPacketSize); // on the node of the core receiving into it
 	}
 }
\ No newline at end of file
@@ -2,6 +2,7 @@
 
 #include "Client.h"
 #include "ChannelProperties.h"
+#include "ControlMessage.h"
 
 #include <string>
 #include <vector>
@@ -21,6 +22,8 @@ namespace Networking
 	{
 		std::vector<unsigned char> Data;
 		Timestamp Timestamp;
+		double ArrivalTime; // [ms] on the client's clock (see ClockModel::Now), when the packet's header was received
+		bool Queued; // the header was already waiting in the socket when the client came to read it - it arrived earlier than ArrivalTime says
 	};
 
 	// manages its own memory
@@ -29,13 +32,28 @@ namespace Networking
 		ChannelProperties* _channelProperties;
 		char* _networkBuffer;
 		unsigned int _maximalPacketSize;
+		unsigned int _skippedPackets;
+		double _headerArrivalTime; // of the last header received
+		bool _headerQueued;
+		std::vector<char> _unsentControlBytes; // the tail of a control message the socket only took part of
 
 	public:
-		PacketClient(std::string clientName) : Client(clientName), _channelProperties(NULL), _networkBuffer(NULL), _maximalPacketSize(0) {}
+		PacketClient(std::string clientName) : Client(clientName), _channelProperties(NULL), _networkBuffer(NULL), _maximalPacketSize(0), _skippedPackets(0), _headerArrivalTime(0), _headerQueued(false) {}
 		~PacketClient();
 
-		const ChannelProperties* ReceiveMetadataPacket(); // call 1st - after connection to server !!
-		void AllocateBuffers(); // call 2nd
+		const ChannelProperties* ReceiveMetadataPacket(); // call 1st - after connection to server !! (after a reconnection, returns the same object)
+		const ChannelProperties* GetChannelProperties() const { return _channelProperties; } // of the metadata received last, NULL before any
+		void AllocateBuffers(); // call 2nd (after a reconnection, keeps the existing buffers)
 		NetworkPacket ReceivePacket(); // call 3rd
+		NetworkPacket ReceiveLatestPacket(); // alternative to ReceivePacket - skips the packets that already have a newer one waiting behind them
+		unsigned int SkippedPackets() const { return _skippedPackets; } // stale packets skipped by ReceiveLatestPacket
+
+		// never blocks: a server that doesn't read control messages (the Jetson boards don't, so far) eventually fills the socket's
+		// send buffer, and from then on the messages are dropped (returns false) rather than stalling the camera thread
+		bool SendControlMessage(const ControlMessage& message);
+
+	private:
+		bool ReceivePacketHeader(Timestamp& timestamp, unsigned int& dataSize); // timestamp and payload size - false if the server has closed connection
+		NetworkPacket ReceivePacketPayload(Timestamp timestamp, unsigned int dataSize);
 	};
 }
\ No newline at end of file
@@ -0,0 +1,249 @@
+#include "ParallelJpegDecoder.h"
+#include <opencv2/highgui/highgui.hpp>
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+
+namespace Networking
+{
+	const unsigned char MarkerPrefix = 0xFF;
+	const unsigned char StartOfImage = 0xD8;
+	const unsigned char EndOfImage = 0xD9;
+	const unsigned char StartOfScan = 0xDA;
+	const unsigned char DefineRestartInterval = 0xDD;
+	const unsigned char FirstRestartMarker = 0xD0; // RST0 - RST7
+	const unsigned char LastRestartMarker = 0xD7;
+	const unsigned char BaselineStartOfFrame = 0xC0;
+	const unsigned char ExtendedStartOfFrame = 0xC1;
+
+	// the parts of a baseline JPEG that matter for splitting it
+	struct JpegLayout
+	{
+		size_t Begin; // of the SOI marker
+		size_t HeightOffset; // of the height field in the SOF segment
+		int Width, Height;
+		int McuWidth, McuHeight; // [pixels]
+		int RestartInterval; // [MCUs], 0 - no restart markers
+		size_t EntropyBegin; // right after the SOS segment
+		size_t End; // right after the EOI marker
+		std::vector<size_t> RestartMarkers; // offsets of the restart markers in the entropy coded data
+	};
+
+	static int ReadBigEndian16(const unsigned char* data) { return (data[0] << 8) | data[1]; }
+
+	// parses one JPEG starting at begin; false if it isn't a single scan baseline JPEG
+	static bool ParseJpeg(const std::vector<unsigned char>& data, size_t begin, JpegLayout& layout)
+	{
+		layout = JpegLayout();
+		layout.Begin = begin;
+		if (begin + 4 > data.size() || data[begin] != MarkerPrefix || data[begin + 1] != StartOfImage) return false;
+
+		bool frameFound = false;
+		size_t position = begin + 2;
+		while (position + 4 <= data.size())
+		{
+			if (data[position] != MarkerPrefix) return false;
+			unsigned char marker = data[position + 1];
+			if (marker == MarkerPrefix) { position++; continue; } // fill bytes
+
+			size_t segmentLength = ReadBigEndian16(&data[position + 2]);
+			size_t segmentBegin = position + 4;
+			if (position + 2 + segmentLength > data.size()) return false;
+
+			if (marker == BaselineStartOfFrame || marker == ExtendedStartOfFrame)
+			{
+				layout.HeightOffset = segmentBegin + 1;
+				layout.Height = ReadBigEndian16(&data[segmentBegin + 1]);
+				layout.Width = ReadBigEndian16(&data[segmentBegin + 3]);
+				int components = data[segmentBegin + 5];
+				if (segmentLength < 8 + 3 * (size_t)components) return false;
+				int maximalHorizontalSampling = 1, maximalVerticalSampling = 1;
+				for (int i = 0; i < components && components > 1; i++) // a single component scan is made of 8x8 blocks whatever its sampling
+				{
+					unsigned char sampling = data[segmentBegin + 6 + 3 * i + 1];
+					maximalHorizontalSampling = std::max(maximalHorizontalSampling, sampling >> 4);
+					maximalVerticalSampling = std::max(maximalVerticalSampling, sampling & 0x0F);
+				}
+				layout.McuWidth = 8 * maximalHorizontalSampling;
+				layout.McuHeight = 8 * maximalVerticalSampling;
+				frameFound = true;
+			}
+			else if (marker >= 0xC2 && marker <= 0xCF && marker != 0xC4 && marker != 0xC8 && marker != 0xCC)
+			{
+				return false; // progressive, lossless or arithmetic coded
+			}
+			else if (marker == DefineRestartInterval)
+			{
+				layout.RestartInterval = ReadBigEndian16(&data[segmentBegin]);
+			}
+			else if (marker == StartOfScan)
+			{
+				if (!frameFound) return false;
+				layout.EntropyBegin = position + 2 + segmentLength;
+
+				// in entropy coded data, 0xFF is followed by a stuffed 0x00 or by a restart marker - anything else ends the scan
+				const unsigned char* end = data.data() + data.size();
+				for (const unsigned char* prefix = data.data() + layout.EntropyBegin; (prefix = (const unsigned char*)memchr(prefix, MarkerPrefix, end - prefix)) != NULL; prefix++)
+				{
+					size_t i = prefix - data.data();
+					if (i + 1 == data.size()) return false;
+					if (data[i + 1] == 0) continue;
+					if (data[i + 1] >= FirstRestartMarker && data[i + 1] <= LastRestartMarker)
+					{
+						layout.RestartMarkers.push_back(i);
+						prefix++;
+						continue;
+					}
+					if (data[i + 1] != EndOfImage) return false; // a second scan
+					layout.End = i + 2;
+					return true;
+				}
+				return false;
+			}
+
+			position += 2 + segmentLength;
+		}
+
+		return false;
+	}
+
+	// decodes each band straight into its rows of the output
+	class BandDecoder : public cv::ParallelLoopBody
+	{
+		const std::vector<const unsigned char*>& _data;
+		const std::vector<int>& _sizes;
+		const std::vector<cv::Range>& _rows;
+		cv::Mat& _output;
+		volatile bool& _failed;
+
+	public:
+		BandDecoder(const std::vector<const unsigned char*>& data, const std::vector<int>& sizes, const std::vector<cv::Range>& rows, cv::Mat& output, volatile bool& failed) :
+			_data(data), _sizes(sizes), _rows(rows), _output(output), _failed(failed) {}
+
+		void operator()(const cv::Range& bands) const
+		{
+			for (int band = bands.start; band < bands.end; band++)
+			{
+				cv::Mat bandOutput = _output.rowRange(_rows[band]);
+				cv::Mat decoded = cv::imdecode(cv::Mat(1, _sizes[band], CV_8UC1, (void*)_data[band]), CV_LOAD_IMAGE_COLOR, &bandOutput);
+				if (decoded.data != bandOutput.data) _failed = true; // the band didn't have the expected size
+			}
+		}
+	};
+
+	ParallelJpegDecoder::ParallelJpegDecoder(int maximalBands) : _maximalBands(maximalBands > 1 ? maximalBands : 1), _bandBuffers(_maximalBands), _bandsInBuffers(false)
+	{
+	}
+
+	bool ParallelJpegDecoder::Decode(const std::vector<unsigned char>& jpeg, cv::Mat& output)
+	{
+		_bandData.clear();
+		_bandRows.clear();
+
+		JpegLayout layout;
+		if (!ParseJpeg(jpeg, 0, layout)) return false;
+		_bandsInBuffers = layout.End == jpeg.size(); // a single JPEG - restart markers are the only way to split it
+		if (_bandsInBuffers ? !SplitAtRestartMarkers(jpeg, layout) : !SplitConcatenatedBands(jpeg, layout)) return false;
+
+		int height = _bandRows.back().end;
+		if (layout.Width != output.cols || height != output.rows) // like imdecode, a frame of another size gets a buffer of its own
+			output = cv::Mat(height, layout.Width, output.type());
+
+		std::vector<const unsigned char*> data;
+		std::vector<int> sizes;
+		for (size_t band = 0; band < _bandRows.size(); band++)
+		{
+			data.push_back(_bandsInBuffers ? _bandBuffers[band].data() : jpeg.data() + _bandData[band].start);
+			sizes.push_back(_bandsInBuffers ? (int)_bandBuffers[band].size() : _bandData[band].size());
+		}
+
+		volatile bool failed = false;
+		BandDecoder bandDecoder(data, sizes, _bandRows, output, failed);
+		if (_maximalBands > 1) cv::parallel_for_(cv::Range(0, (int)_bandRows.size()), bandDecoder);
+		else bandDecoder(cv::Range(0, (int)_bandRows.size())); // a stream sent in bands, on a client that decodes on one core
+
+		return !failed;
+	}
+
+	bool ParallelJpegDecoder::SplitAtRestartMarkers(const std::vector<unsigned char>& jpeg, const JpegLayout& layout)
+	{
+		if (_maximalBands < 2 || layout.RestartInterval == 0) return false;
+
+		// restart marker i (1-based) starts MCU i * RestartInterval - the ones starting an MCU row are where bands can begin
+		int mcusPerRow = (layout.Width + layout.McuWidth - 1) / layout.McuWidth;
+		int mcuRows = (layout.Height + layout.McuHeight - 1) / layout.McuHeight;
+		std::vector<int> rowStartingMarkers; // index into layout.RestartMarkers, by MCU row
+		std::vector<int> markerRows;
+		for (size_t i = 0; i < layout.RestartMarkers.size(); i++)
+		{
+			long long mcu = (long long)(i + 1) * layout.RestartInterval;
+			if (mcu % mcusPerRow == 0 && mcu / mcusPerRow < mcuRows)
+			{
+				rowStartingMarkers.push_back((int)i);
+				markerRows.push_back((int)(mcu / mcusPerRow));
+			}
+		}
+		if (rowStartingMarkers.empty()) return false;
+
+		// evenly spread band boundaries over the MCU rows, snapped to the nearest row that starts with a restart marker
+		int bands = std::min(_maximalBands, (int)rowStartingMarkers.size() + 1);
+		std::vector<int> boundaries; // indices into rowStartingMarkers
+		for (int band = 1; band < bands; band++)
+		{
+			int targetRow = band * mcuRows / bands;
+			int best = 0;
+			for (int i = 1; i < (int)markerRows.size(); i++)
+				if (abs(markerRows[i] - targetRow) < abs(markerRows[best] - targetRow)) best = i;
+			if (boundaries.empty() || best > boundaries.back()) boundaries.push_back(best);
+		}
+		if (boundaries.empty()) return false;
+
+		size_t headerSize = layout.EntropyBegin;
+		for (size_t band = 0; band <= boundaries.size(); band++)
+		{
+			int firstRow = band == 0 ? 0 : markerRows[boundaries[band - 1]];
+			int endRow = band == boundaries.size() ? mcuRows : markerRows[boundaries[band]];
+			size_t entropyBegin = band == 0 ? layout.EntropyBegin : layout.RestartMarkers[rowStartingMarkers[boundaries[band - 1]]] + 2;
+			size_t entropyEnd = band == boundaries.size() ? layout.End - 2 : layout.RestartMarkers[rowStartingMarkers[boundaries[band]]];
+			int firstPixelRow = firstRow * layout.McuHeight;
+			int endPixelRow = std::min(endRow * layout.McuHeight, layout.Height);
+
+			// the original headers with the band's height, the band's data, and an EOI
+			std::vector<unsigned char>& buffer = _bandBuffers[band];
+			buffer.assign(jpeg.begin(), jpeg.begin() + headerSize);
+			buffer[layout.HeightOffset] = (unsigned char)((endPixelRow - firstPixelRow) >> 8);
+			buffer[layout.HeightOffset + 1] = (unsigned char)((endPixelRow - firstPixelRow) & 0xFF);
+			buffer.insert(buffer.end(), jpeg.begin() + entropyBegin, jpeg.begin() + entropyEnd);
+			buffer.push_back(MarkerPrefix);
+			buffer.push_back(EndOfImage);
+
+			// a decoder expects the restart markers of a scan to count up from RST0
+			size_t firstMarker = band == 0 ? 0 : rowStartingMarkers[boundaries[band - 1]] + 1;
+			size_t endMarker = band == boundaries.size() ? layout.RestartMarkers.size() : rowStartingMarkers[boundaries[band]];
+			for (size_t marker = firstMarker; marker < endMarker; marker++)
+				buffer[headerSize + layout.RestartMarkers[marker] - entropyBegin + 1] = (unsigned char)(FirstRestartMarker + (marker - firstMarker) % 8);
+
+			_bandRows.push_back(cv::Range(firstPixelRow, endPixelRow));
+		}
+
+		return true;
+	}
+
+	bool ParallelJpegDecoder::SplitConcatenatedBands(const std::vector<unsigned char>& jpeg, const JpegLayout& firstBand)
+	{
+		int row = 0;
+		for (size_t position = 0; position < jpeg.size(); )
+		{
+			JpegLayout layout;
+			if (position == 0) layout = firstBand;
+			else if (!ParseJpeg(jpeg, position, layout) || layout.Width != firstBand.Width) return false;
+
+			_bandData.push_back(cv::Range((int)layout.Begin, (int)layout.End));
+			_bandRows.push_back(cv::Range(row, row + layout.Height));
+			row += layout.Height;
+			position = layout.End;
+		}
+
+		return _bandRows.size() > 1;
+	}
+}
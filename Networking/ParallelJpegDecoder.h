@@ -0,0 +1,33 @@
+#pragma once
+
+#include <opencv2/core/core.hpp>
+#include <vector>
+
+namespace Networking
+{
+	struct JpegLayout; // see the .cpp
+
+	// decodes a single JPEG frame on several cores, by splitting it into horizontal bands that can be decoded independently:
+	// - a frame with restart markers at the start of MCU rows is cut at those markers. Every band becomes a JPEG of its own - the
+	//   original headers with the band's height, and the band's entropy coded data (restart markers renumbered from 0).
+	// - a frame sent as several JPEGs, one per band, stacked top to bottom in one packet, is decoded band by band as it is.
+	// Frames that can't be split (no suitable restart markers, progressive...) are left to the caller.
+	class ParallelJpegDecoder
+	{
+		int _maximalBands;
+		std::vector<std::vector<unsigned char>> _bandBuffers; // reused from frame to frame
+		bool _bandsInBuffers; // the bands are in _bandBuffers, otherwise in the packet at _bandData
+		std::vector<cv::Range> _bandData; // [begin, end) of each band's JPEG in the packet
+		std::vector<cv::Range> _bandRows;
+
+	public:
+		ParallelJpegDecoder(int maximalBands); // how many bands a frame with restart markers is cut into, at most. 1 (or less) - bands sent separately are decoded one after the other
+
+		// output - a BGR frame, replaced by a new one when the JPEG has another size (a reduced resolution stream). False if the frame couldn't be split or decoded
+		bool Decode(const std::vector<unsigned char>& jpeg, cv::Mat& output);
+
+	private:
+		bool SplitAtRestartMarkers(const std::vector<unsigned char>& jpeg, const JpegLayout& layout);
+		bool SplitConcatenatedBands(const std::vector<unsigned char>& jpeg, const JpegLayout& firstBand);
+	};
+}
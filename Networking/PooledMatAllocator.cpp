@@ -0,0 +1,154 @@
+#include "PooledMatAllocator.h"
+
+#include <winsock2.h>
+#include <windows.h>
+#include <malloc.h>
+#include <stdio.h>
+
+namespace Networking
+{
+	const int SmallestPooledSizeLog = 16; // 64 KB - below that the heap does fine
+	const int SizeClassCount = 11; // up to 64 MB, anything larger goes to the heap
+	const size_t BlockHeaderSize = 64; // keeps the data cache line aligned (and the list entry 16 byte aligned, as SLIST requires)
+
+	struct ThreadPool
+	{
+		SLIST_HEADER FreeBlocks[SizeClassCount];
+	};
+
+	struct BlockHeader
+	{
+		SLIST_ENTRY Entry; // must be first - a block is pushed on the free list by its header
+		ThreadPool* Owner;
+		int SizeClass;
+	};
+
+	static thread_local ThreadPool* CurrentThreadPool = NULL; // a private pool, NULL - the shared one (see UseThreadPool)
+
+	static ThreadPool* CreatePool()
+	{
+		ThreadPool* pool = (ThreadPool*)_aligned_malloc(sizeof(ThreadPool), MEMORY_ALLOCATION_ALIGNMENT);
+		if (!pool) throw std::bad_alloc();
+		for (int i = 0; i < SizeClassCount; i++) InitializeSListHead(&pool->FreeBlocks[i]);
+
+		return pool;
+	}
+
+	static ThreadPool* GetCurrentThreadPool()
+	{
+		static ThreadPool* sharedPool = CreatePool(); // never freed - buffers allocated from it may be in use until the very end
+
+		return CurrentThreadPool ? CurrentThreadPool : sharedPool;
+	}
+
+	static int SizeClass(size_t size) // -1 if the size isn't pooled
+	{
+		if (size < (size_t)1 << SmallestPooledSizeLog) return -1;
+
+		for (int sizeClass = 0; sizeClass < SizeClassCount; sizeClass++)
+			if (size <= (size_t)1 << (SmallestPooledSizeLog + sizeClass)) return sizeClass;
+
+		return -1;
+	}
+
+	bool PooledMatAllocator::IsPooled(size_t size)
+	{
+		return SizeClass(size) >= 0;
+	}
+
+	void PooledMatAllocator::UseThreadPool()
+	{
+		if (!CurrentThreadPool) CurrentThreadPool = CreatePool(); // outlives the thread - buffers allocated there may still be in use
+	}
+
+	cv::UMatData* PooledMatAllocator::allocate(int dims, const int* sizes, int type, void* data0, size_t* step, int /*flags*/, cv::UMatUsageFlags /*usageFlags*/) const
+	{
+		// the steps are computed exactly like OpenCV's own allocator does
+		size_t total = CV_ELEM_SIZE(type);
+		for (int i = dims - 1; i >= 0; i--)
+		{
+			if (step)
+			{
+				if (data0 && step[i] != CV_AUTOSTEP)
+				{
+					CV_Assert(total <= step[i]);
+					total = step[i];
+				}
+				else
+				{
+					step[i] = total;
+				}
+			}
+			total *= sizes[i];
+		}
+
+		uchar* data = (uchar*)data0;
+		int sizeClass = SizeClass(total);
+		if (!data && sizeClass < 0)
+		{
+			data = (uchar*)cv::fastMalloc(total);
+		}
+		else if (!data)
+		{
+			ThreadPool* pool = GetCurrentThreadPool();
+			BlockHeader* block = (BlockHeader*)InterlockedPopEntrySList(&pool->FreeBlocks[sizeClass]);
+			if (block)
+			{
+				InterlockedIncrement64(&_pooledAllocations);
+			}
+			else
+			{
+				size_t blockSize = (size_t)1 << (SmallestPooledSizeLog + sizeClass);
+				block = (BlockHeader*)_aligned_malloc(BlockHeaderSize + blockSize, BlockHeaderSize);
+				if (!block) throw std::bad_alloc();
+				block->Owner = pool;
+				block->SizeClass = sizeClass;
+				InterlockedIncrement64(&_freshAllocations);
+				InterlockedAdd64(&_heldBytes, blockSize);
+			}
+			data = (uchar*)block + BlockHeaderSize;
+		}
+
+		cv::UMatData* u = new cv::UMatData(this);
+		u->data = u->origdata = data;
+		u->size = total;
+		if (data0) u->flags |= cv::UMatData::USER_ALLOCATED;
+
+		return u;
+	}
+
+	bool PooledMatAllocator::allocate(cv::UMatData* u, int /*accessFlags*/, cv::UMatUsageFlags /*usageFlags*/) const
+	{
+		return u != NULL;
+	}
+
+	void PooledMatAllocator::deallocate(cv::UMatData* u) const
+	{
+		if (!u) return;
+
+		CV_Assert(u->urefcount == 0);
+		CV_Assert(u->refcount == 0);
+		if (!(u->flags & cv::UMatData::USER_ALLOCATED))
+		{
+			if (SizeClass(u->size) < 0)
+			{
+				cv::fastFree(u->origdata);
+			}
+			else
+			{
+				BlockHeader* block = (BlockHeader*)(u->origdata - BlockHeaderSize);
+				InterlockedPushEntrySList(&block->Owner->FreeBlocks[block->SizeClass], &block->Entry); // whichever thread frees it
+			}
+			u->origdata = 0;
+		}
+
+		delete u;
+	}
+
+	std::string PooledMatAllocator::ToString() const
+	{
+		char description[128];
+		sprintf_s(description, "%lld allocations served from the pools, %lld new buffers, %2.1f [MB] held", _pooledAllocations, _freshAllocations, _heldBytes / (1024. * 1024.));
+		return description;
+	}
+}
@@ -0,0 +1,38 @@
+#pragma once
+
+#include <opencv2/core/core.hpp>
+#include <string>
+
+namespace Networking
+{
+	// a cv::Mat allocator that recycles large buffers instead of returning them to the heap
+	// every frame allocates the same few full-frame temporaries (depth conversion, display scaling, OpenCV's own temporaries in
+	// findChessboardCorners...), so after the first frames every allocation is served from a pool. Buffers of 64 KB and more are
+	// rounded up to a power of two size class; smaller ones go to the heap as usual. Threads allocate from pools shared by all of them,
+	// except for the long-lived ones that ask for pools of their own (UseThreadPool - the camera threads, to keep their buffers on their
+	// NUMA node). A buffer freed on another thread (e.g. a frame handed to the display) goes back to the pool it came from, through a
+	// lock-free list. Pooled buffers are never returned to the heap, so the memory held is the peak memory in use - which is why
+	// short-lived threads (e.g. a calibration solve) must stay on the shared pools: a private pool is lost when its thread exits.
+	// Install with cv::Mat::setDefaultAllocator before any thread allocates, and keep it alive for as long as any Mat it allocated.
+	class PooledMatAllocator : public cv::MatAllocator
+	{
+		mutable volatile long long _pooledAllocations;
+		mutable volatile long long _freshAllocations;
+		mutable volatile long long _heldBytes;
+
+	public:
+		PooledMatAllocator() : _pooledAllocations(0), _freshAllocations(0), _heldBytes(0) {}
+
+		cv::UMatData* allocate(int dims, const int* sizes, int type, void* data, size_t* step, int flags, cv::UMatUsageFlags usageFlags) const;
+		bool allocate(cv::UMatData* data, int accessFlags, cv::UMatUsageFlags usageFlags) const;
+		void deallocate(cv::UMatData* data) const;
+
+		long long PooledAllocations() const { return _pooledAllocations; } // heap allocations avoided
+		long long FreshAllocations() const { return _freshAllocations; } // pooled buffers that had to be allocated (warm-up, or a new size)
+		long long HeldBytes() const { return _heldBytes; } // by all the pools, in use or free
+		std::string ToString() const;
+
+		static bool IsPooled(size_t size); // false if buffers of this size go to the heap
+		static void UseThreadPool(); // the calling thread allocates from pools of its own from now on - only for threads that live as long as the allocator
+	};
+}
@@ -0,0 +1,92 @@
+#include "QualityController.h"
+
+namespace Networking
+{
+	const float KinectFramePeriod = 1000.f / 30; // [ms]
+	const float RunningAverageWeight = 0.1f;
+
+	const unsigned int FramesOverTargetBeforeDegrading = 5; // react quickly when falling behind...
+	const unsigned int FramesUnderTargetBeforeImproving = 90; // ...but wait a few seconds before trying a better setting again
+	const float ImprovementLatencyFraction = 0.5f; // the latency must stay under this fraction of the target before improving
+	const unsigned int FramesBetweenReports = 30;
+
+	const unsigned char JpegQualityStep = 10;
+	const unsigned char MinimalJpegQuality = 45;
+	const unsigned char MaximalFrameRateDivider = 3;
+	const unsigned char MaximalResolutionDivider = 2;
+
+	QualityController::QualityController(float targetLatency, enum ChannelType channelType) : _targetLatency(targetLatency), _jpegStream(ChannelProperties(channelType).IsColor()), _framesOverTarget(0), _framesUnderTarget(0), 
+		_framesSinceLastReport(0), _averagePacketSize(0), _averageDecodeTime(0)
+	{
+	}
+
+	bool QualityController::Update(unsigned int packetSize, unsigned int pendingBytes, float decodeTime, ControlMessage& message)
+	{
+		if (_averagePacketSize == 0)
+		{
+			_averagePacketSize = (float)packetSize;
+			_averageDecodeTime = decodeTime;
+		}
+		_averagePacketSize += RunningAverageWeight * (packetSize - _averagePacketSize);
+		_averageDecodeTime += RunningAverageWeight * (decodeTime - _averageDecodeTime);
+
+		// the frames already waiting will each take at least a frame period (of the current frame rate) or a decode time to get through
+		float queueDepth = pendingBytes / _averagePacketSize;
+		float framePeriod = KinectFramePeriod * _settings.FrameRateDivider;
+		float latency = queueDepth * (framePeriod > _averageDecodeTime ? framePeriod : _averageDecodeTime) + _averageDecodeTime;
+
+		_framesOverTarget = latency > _targetLatency ? _framesOverTarget + 1 : 0;
+		_framesUnderTarget = latency < ImprovementLatencyFraction * _targetLatency ? _framesUnderTarget + 1 : 0;
+
+		bool settingsChanged = false;
+		if (_framesOverTarget >= FramesOverTargetBeforeDegrading)
+		{
+			settingsChanged = Degrade();
+			_framesOverTarget = 0;
+		}
+		else if (_framesUnderTarget >= FramesUnderTargetBeforeImproving)
+		{
+			settingsChanged = Improve();
+			_framesUnderTarget = 0;
+		}
+
+		if (!settingsChanged && ++_framesSinceLastReport < FramesBetweenReports)
+			return false;
+
+		_framesSinceLastReport = 0;
+		_settings.QueueDepth = (unsigned short)queueDepth;
+		_settings.DecodeTime = _averageDecodeTime;
+		_settings.EstimatedLatency = (unsigned short)latency;
+		message = _settings;
+
+		return true;
+	}
+
+	bool QualityController::Degrade()
+	{
+		if (_jpegStream && _settings.JpegQuality - JpegQualityStep >= MinimalJpegQuality)
+			_settings.JpegQuality -= JpegQualityStep;
+		else if (_settings.FrameRateDivider < MaximalFrameRateDivider)
+			_settings.FrameRateDivider++;
+		else if (_settings.ResolutionDivider < MaximalResolutionDivider)
+			_settings.ResolutionDivider++;
+		else
+			return false; // nothing left to give up
+
+		return true;
+	}
+
+	bool QualityController::Improve()
+	{
+		if (_settings.ResolutionDivider > 1)
+			_settings.ResolutionDivider--;
+		else if (_settings.FrameRateDivider > 1)
+			_settings.FrameRateDivider--;
+		else if (_jpegStream && _settings.JpegQuality + JpegQualityStep <= MaximalJpegQuality)
+			_settings.JpegQuality += JpegQualityStep;
+		else
+			return false; // already at full quality
+
+		return true;
+	}
+}
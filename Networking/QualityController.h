@@ -0,0 +1,34 @@
+#pragma once
+
+#include "ControlMessage.h"
+#include "ChannelProperties.h"
+
+namespace Networking
+{
+	// decides which stream settings to ask the server for, so that the client's end-to-end latency stays under a target
+	// the latency is estimated as the time it would take to drain the frames already waiting in the socket buffer plus the decode time.
+	// When the estimate stays above the target, the stream is degraded one step at a time (JPEG quality first, then frame rate,
+	// then resolution); when it stays well below the target, the steps are undone in reverse order.
+	class QualityController
+	{
+		float _targetLatency; // [ms]
+		bool _jpegStream; // JPEG quality is only a knob for color streams (depth and IR are lossless PNG) - video streams map it to the encoder's quality
+		ControlMessage _settings;
+
+		unsigned int _framesOverTarget;
+		unsigned int _framesUnderTarget;
+		unsigned int _framesSinceLastReport;
+		float _averagePacketSize; // [bytes], running average
+		float _averageDecodeTime; // [ms], running average
+
+	public:
+		QualityController(float targetLatency, enum ChannelType channelType);
+
+		// call once per frame; returns true if message should be sent to the server (settings changed, or a periodic report is due)
+		bool Update(unsigned int packetSize, unsigned int pendingBytes, float decodeTime, ControlMessage& message);
+
+	private:
+		bool Degrade();
+		bool Improve();
+	};
+}
@@ -0,0 +1,153 @@
+#include "RelayServer.h"
+#include "VideoDecoder.h"
+#include "ThreadPlacement.h"
+#include <process.h>
+#include <math.h>
+#include <stdio.h>
+
+namespace Networking
+{
+	const unsigned int BytesInHeader = 3; // as in PacketClient - the payload size
+	const unsigned int BytesInTimestampField = 4;
+	const int SubscriberSendBuffer = 8 << 20; // [bytes], room for a few dozen frames - a subscriber that falls further behind is dropped
+	const long SubscriberPollPeriod = 100; // [ms] between checks for new subscribers and for ones that went away
+
+	RelayServer::RelayServer(unsigned short port, enum ChannelType channelType) : _port(port), _channelType(channelType), _listeningSocket(INVALID_SOCKET),
+		_acceptThread(NULL), _stopping(false), _keyframeWanted(false), _subscribersServed(0), _subscribersDropped(0)
+	{
+		WSADATA wsaData;
+		if (WSAStartup(MAKEWORD(2, 2), &wsaData) != 0) throw std::runtime_error("WSAStartup failed");
+		InitializeCriticalSection(&_lock);
+
+		sockaddr_in address = { 0 };
+		address.sin_family = AF_INET;
+		address.sin_addr.s_addr = htonl(INADDR_ANY);
+		address.sin_port = htons(_port);
+
+		_listeningSocket = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+		if (_listeningSocket == INVALID_SOCKET || bind(_listeningSocket, (sockaddr*)&address, sizeof(address)) == SOCKET_ERROR || listen(_listeningSocket, SOMAXCONN) == SOCKET_ERROR)
+			throw std::runtime_error("Relay could not listen on port " + std::to_string(_port) + ": " + std::to_string(WSAGetLastError()));
+
+		_acceptThread = (HANDLE)_beginthreadex(NULL, 0, &AcceptThreadFunction, this, 0, NULL);
+	}
+
+	RelayServer::~RelayServer()
+	{
+		_stopping = true;
+		WaitForSingleObject(_acceptThread, INFINITE);
+		CloseHandle(_acceptThread);
+
+		closesocket(_listeningSocket);
+		for (SOCKET subscriber : _subscribers) closesocket(subscriber);
+
+		DeleteCriticalSection(&_lock);
+		WSACleanup();
+	}
+
+	void RelayServer::Forward(const NetworkPacket& packet, double captureTime)
+	{
+		// the same header the boards send - seconds and milliseconds, then the payload size (3 bytes, little endian)
+		unsigned char header[2 * BytesInTimestampField + BytesInHeader];
+		long timestamp[2] = { (long)floor(captureTime / 1000), (long)fmod(captureTime, 1000.) };
+		memcpy(header, timestamp, sizeof(timestamp));
+		unsigned int size = (unsigned int)packet.Data.size();
+		for (unsigned int i = 0; i < BytesInHeader; i++) header[2 * BytesInTimestampField + i] = (unsigned char)(size >> (8 * i));
+
+		WSABUF buffers[2];
+		buffers[0].buf = (char*)header;
+		buffers[0].len = sizeof(header);
+		buffers[1].buf = (char*)packet.Data.data();
+		buffers[1].len = size;
+
+		if (_keyframeWanted && VideoDecoder::IsKeyframe(packet.Data, _channelType)) _keyframeWanted = false;
+
+		EnterCriticalSection(&_lock);
+		for (size_t i = _subscribers.size(); i-- > 0; )
+		{
+			DWORD sent = 0;
+			if (WSASend(_subscribers[i], buffers, 2, &sent, 0, NULL, NULL) == SOCKET_ERROR || sent < sizeof(header) + size) // full send buffer (WSAEWOULDBLOCK) included
+				DropSubscriber(i); // a partial packet would corrupt its stream anyway
+		}
+		LeaveCriticalSection(&_lock);
+	}
+
+	std::string RelayServer::ToString() const
+	{
+		EnterCriticalSection(&_lock);
+		size_t subscribers = _subscribers.size();
+		LeaveCriticalSection(&_lock);
+
+		char description[128];
+		sprintf_s(description, "port %d, %d subscriber(s) now, %d served, %d dropped for being too slow", _port, (int)subscribers, _subscribersServed, _subscribersDropped);
+		return description;
+	}
+
+	unsigned __stdcall RelayServer::AcceptThreadFunction(void* relayServer)
+	{
+		ThreadPlacement::PinGeneralThread(); // stay off the cores of the camera threads
+		((RelayServer*)relayServer)->ServeSubscribers();
+		return 0;
+	}
+
+	void RelayServer::ServeSubscribers()
+	{
+		while (!_stopping)
+		{
+			fd_set readable;
+			FD_ZERO(&readable);
+			FD_SET(_listeningSocket, &readable);
+			EnterCriticalSection(&_lock);
+			for (SOCKET subscriber : _subscribers) FD_SET(subscriber, &readable); // up to FD_SETSIZE
+			LeaveCriticalSection(&_lock);
+
+			timeval timeout = { 0, SubscriberPollPeriod * 1000 };
+			if (select(0, &readable, NULL, NULL, &timeout) <= 0) continue;
+
+			EnterCriticalSection(&_lock);
+
+			// whatever subscribers send is read and discarded; an orderly close or an error means they are gone
+			for (size_t i = _subscribers.size(); i-- > 0; )
+			{
+				if (!FD_ISSET(_subscribers[i], &readable)) continue;
+				char discarded[BytesInControlMessage * 16];
+				int received = recv(_subscribers[i], discarded, sizeof(discarded), 0);
+				if (received == 0 || (received == SOCKET_ERROR && WSAGetLastError() != WSAEWOULDBLOCK))
+				{
+					closesocket(_subscribers[i]);
+					_subscribers.erase(_subscribers.begin() + i);
+				}
+			}
+
+			if (FD_ISSET(_listeningSocket, &readable))
+			{
+				SOCKET subscriber = accept(_listeningSocket, NULL, NULL);
+				char metadata = (char)_channelType;
+				u_long nonBlocking = 1;
+				BOOL noDelay = TRUE;
+				if (subscriber != INVALID_SOCKET && send(subscriber, &metadata, 1, 0) == 1 && // sent while still blocking - the first thing a subscriber reads
+					setsockopt(subscriber, SOL_SOCKET, SO_SNDBUF, (const char*)&SubscriberSendBuffer, sizeof(SubscriberSendBuffer)) == 0 &&
+					setsockopt(subscriber, IPPROTO_TCP, TCP_NODELAY, (const char*)&noDelay, sizeof(noDelay)) == 0 &&
+					ioctlsocket(subscriber, FIONBIO, &nonBlocking) == 0)
+				{
+					_subscribers.push_back(subscriber); // from the next Forward on - always at a packet boundary
+					_subscribersServed++;
+					if (ChannelProperties(_channelType).IsVideo()) _keyframeWanted = true;
+				}
+				else if (subscriber != INVALID_SOCKET)
+				{
+					closesocket(subscriber);
+				}
+			}
+
+			LeaveCriticalSection(&_lock);
+		}
+	}
+
+	void RelayServer::DropSubscriber(size_t index)
+	{
+		printf("Relay on port %d: dropped a subscriber that could not keep up\n", _port);
+		closesocket(_subscribers[index]);
+		_subscribers.erase(_subscribers.begin() + index);
+		_subscribersDropped++;
+	}
+}
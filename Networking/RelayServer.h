@@ -0,0 +1,47 @@
+#pragma once
+
+#include "PacketClient.h" // first - brings in winsock2.h, which must come before windows.h
+#include <string>
+#include <vector>
+#include <windows.h>
+
+namespace Networking
+{
+	// re-serves one camera's packets to any number of local or remote subscribers, so they all share the client's single connection to
+	// the board. Subscribers connect and read exactly as if it were the board (metadata byte, then timestamped packets) - a KinectClient
+	// given -host and -port (the relay's base port) works as is. What they receive:
+	// - the packets that made it into a synchronized frameset, stamped with the frameset's capture time on the relay's clock (the same
+	//   for every camera of the frameset), so the subscribers see the framesets the relay saw. Video streams get every packet, as
+	//   their decoders need them all.
+	// - nothing a subscriber sends back is acted on (quality control belongs to the relay's own client), except that a subscriber that
+	//   joins a video stream makes the relay ask the board for a keyframe (see KeyframeWanted).
+	// The payloads are sent straight from the packet (gathered with the header, not copied). The subscribers' sockets never block: a
+	// subscriber whose send buffer is full is too slow to keep up and is disconnected, rather than holding up the camera thread.
+	class RelayServer
+	{
+		unsigned short _port;
+		enum ChannelType _channelType;
+		SOCKET _listeningSocket;
+		std::vector<SOCKET> _subscribers;
+		mutable CRITICAL_SECTION _lock; // guards _subscribers
+		HANDLE _acceptThread;
+		volatile bool _stopping;
+		volatile bool _keyframeWanted;
+		unsigned int _subscribersServed;
+		unsigned int _subscribersDropped;
+
+	public:
+		RelayServer(unsigned short port, enum ChannelType channelType); // starts listening right away
+		~RelayServer();
+
+		void Forward(const NetworkPacket& packet, double captureTime); // captureTime [ms] on the client's clock (see ClockModel)
+		bool KeyframeWanted() const { return _keyframeWanted; } // a subscriber joined a video stream and waits for the next keyframe
+
+		std::string ToString() const;
+
+	private:
+		static unsigned __stdcall AcceptThreadFunction(void* relayServer);
+		void ServeSubscribers(); // accepts new subscribers, and notices the ones that went away
+		void DropSubscriber(size_t index); // call under _lock
+	};
+}
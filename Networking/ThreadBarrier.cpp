@@ -0,0 +1,130 @@
+#include "ThreadBarrier.h"
+#include <algorithm>
+
+namespace Networking
+{
+	ThreadBarrier::ThreadBarrier() : _participants(0), _arrived(0), _currentSite(0), _generation(0)
+	{
+		InitializeCriticalSection(&_lock);
+		InitializeConditionVariable(&_phaseChanged);
+	}
+
+	ThreadBarrier::~ThreadBarrier()
+	{
+		DeleteCriticalSection(&_lock);
+	}
+
+	unsigned long long ThreadBarrier::Enter(int site)
+	{
+		EnterCriticalSection(&_lock);
+		unsigned long long generation = Arrive(site);
+		LeaveCriticalSection(&_lock);
+
+		return generation;
+	}
+
+	unsigned long long ThreadBarrier::Join(int site, volatile bool* participating)
+	{
+		EnterCriticalSection(&_lock);
+		unsigned long long generation;
+
+		// the others are gathering at our site right now (or there are no others) - join this phase
+		if (_participants == 0 || (_arrived > 0 && _currentSite == site))
+		{
+			_participants++;
+			*participating = true; // the others can't leave this phase before we arrive, so they will all see the flag raised
+			generation = Arrive(site);
+			LeaveCriticalSection(&_lock);
+			return generation;
+		}
+
+		// otherwise wait to be admitted into the next phase at our site (see AdmitJoiners)
+		Joiner joiner = { site, participating, false, 0 };
+		_joiners.push_back(&joiner);
+		while (!joiner.Admitted && _participants > 0)
+			SleepConditionVariableCS(&_phaseChanged, &_lock, INFINITE);
+
+		if (!joiner.Admitted) // the others all left before getting there - start over on our own
+		{
+			_joiners.erase(std::find(_joiners.begin(), _joiners.end(), &joiner));
+			_participants++;
+			*participating = true;
+			generation = Arrive(site);
+		}
+		else
+		{
+			while (joiner.Generation == _generation) // already counted as arrived - wait for the phase to be released
+				SleepConditionVariableCS(&_phaseChanged, &_lock, INFINITE);
+			generation = joiner.Generation;
+		}
+
+		LeaveCriticalSection(&_lock);
+		return generation;
+	}
+
+	void ThreadBarrier::Leave(volatile bool* participating)
+	{
+		EnterCriticalSection(&_lock);
+
+		*participating = false;
+		_participants--;
+		if (_arrived > 0 && _arrived == _participants) // the others were only waiting for us
+			ReleasePhase();
+		else
+			WakeAllConditionVariable(&_phaseChanged); // a joiner may be waiting for the last participant to go away
+
+		LeaveCriticalSection(&_lock);
+	}
+
+	unsigned long long ThreadBarrier::Arrive(int site)
+	{
+		if (_arrived == 0)
+		{
+			_currentSite = site;
+			AdmitJoiners(site);
+		}
+		_arrived++;
+
+		unsigned long long generation = _generation;
+		if (_arrived == _participants)
+		{
+			ReleasePhase();
+			return generation;
+		}
+
+		WakeAllConditionVariable(&_phaseChanged); // a joiner may be waiting for a phase to start at this site
+
+		while (generation == _generation)
+			SleepConditionVariableCS(&_phaseChanged, &_lock, INFINITE);
+
+		return generation;
+	}
+
+	void ThreadBarrier::AdmitJoiners(int site)
+	{
+		for (size_t i = 0; i < _joiners.size(); )
+		{
+			Joiner* joiner = _joiners[i];
+			if (joiner->Site != site)
+			{
+				i++;
+				continue;
+			}
+
+			// the joiner is counted as arrived on its behalf, and its flag raised before anyone can leave the phase
+			_participants++;
+			_arrived++;
+			*joiner->Participating = true;
+			joiner->Admitted = true;
+			joiner->Generation = _generation;
+			_joiners.erase(_joiners.begin() + i);
+		}
+	}
+
+	void ThreadBarrier::ReleasePhase()
+	{
+		_arrived = 0;
+		_generation++;
+		WakeAllConditionVariable(&_phaseChanged);
+	}
+}
@@ -0,0 +1,47 @@
+#pragma once
+
+#include <windows.h>
+#include <vector>
+
+namespace Networking
+{
+	// a thread barrier whose set of participants may change while it is in use (unlike SYNCHRONIZATION_BARRIER)
+	// every call to Enter carries a site identifier - the place in the code where the barrier is entered. A joining thread is only
+	// admitted into a phase that is collecting threads at the same site it joins at, so it can never be matched with threads
+	// that are waiting elsewhere in their iteration. A joiner that finds no such phase is admitted by the participant that starts the
+	// next phase at its site - it can't wait for one to be collecting, as a lone participant releases its phases the moment it arrives.
+	class ThreadBarrier
+	{
+		struct Joiner
+		{
+			int Site;
+			volatile bool* Participating;
+			bool Admitted;
+			unsigned long long Generation; // of the phase it was admitted into
+		};
+
+		CRITICAL_SECTION _lock;
+		CONDITION_VARIABLE _phaseChanged;
+
+		unsigned int _participants;
+		unsigned int _arrived; // threads waiting in the current phase
+		int _currentSite; // site of the current phase (meaningful only while _arrived > 0)
+		unsigned long long _generation; // incremented every time a phase is released
+		std::vector<Joiner*> _joiners; // waiting to be admitted, not managed
+
+	public:
+		ThreadBarrier();
+		~ThreadBarrier();
+
+		// both return the generation of the phase the thread passed - the same for all its participants, and growing from phase to phase,
+		// so it can tell apart per-phase state that threads still outside the barrier must not touch
+		unsigned long long Enter(int site); // blocks until all participants have entered
+		unsigned long long Join(int site, volatile bool* participating); // becomes a participant (raising *participating while still holding the barrier) and enters at site
+		void Leave(volatile bool* participating); // stops participating (lowering *participating) - never blocks
+
+	private:
+		unsigned long long Arrive(int site); // called with _lock held
+		void AdmitJoiners(int site); // called with _lock held, as a phase starts at site
+		void ReleasePhase(); // called with _lock held
+	};
+}
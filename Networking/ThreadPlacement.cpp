@@ -0,0 +1,168 @@
+#include <opencv2/core/core.hpp> // before windows.h and its min/max macros
+#include "ThreadPlacement.h"
+
+#include <stdexcept>
+#include <sstream>
+#include <algorithm>
+
+namespace Networking
+{
+	const ThreadPlacement* ThreadPlacement::_active = NULL;
+
+	ThreadPlacement ThreadPlacement::Load(const std::string& path)
+	{
+		cv::FileStorage file(path, cv::FileStorage::READ);
+		if (!file.isOpened()) throw std::runtime_error("Could not open thread placement file " + path);
+
+		ThreadPlacement placement;
+		std::vector<bool> assigned;
+
+		cv::FileNode cameras = file["Cameras"];
+		for (auto camera = cameras.begin(); camera != cameras.end(); ++camera)
+		{
+			std::vector<int> cores;
+			*camera >> cores;
+			placement._cameraCores.push_back(std::vector<unsigned int>(cores.begin(), cores.end()));
+
+			PROCESSOR_NUMBER first = { 0 }, processor;
+			for (size_t i = 0; i < cores.size(); i++)
+			{
+				int core = cores[i];
+				if (core < 0) throw std::runtime_error("Negative core index in thread placement file " + path);
+				if (!ToProcessorNumber(core, processor)) throw std::runtime_error("Core " + std::to_string(core) + " in thread placement file " + path + " does not exist");
+				if (i == 0) first = processor;
+				if (processor.Group != first.Group) throw std::runtime_error("Cores " + std::to_string(cores[0]) + " and " + std::to_string(core) + " of a camera are in different processor groups");
+				if (assigned.size() <= (size_t)core) assigned.resize(core + 1, false);
+				assigned[core] = true;
+			}
+		}
+
+		if (!file["GeneralCores"].isNone())
+		{
+			std::vector<int> cores;
+			file["GeneralCores"] >> cores;
+			placement._generalCores.assign(cores.begin(), cores.end());
+		}
+		else
+		{
+			DWORD coreCount = GetActiveProcessorCount(ALL_PROCESSOR_GROUPS);
+			for (unsigned int core = 0; core < coreCount; core++)
+				if (core >= assigned.size() || !assigned[core]) placement._generalCores.push_back(core);
+		}
+
+		return placement;
+	}
+
+	void ThreadPlacement::Activate() const
+	{
+		_active = this;
+	}
+
+	bool ThreadPlacement::PinCameraThread(unsigned int cameraIndex) const
+	{
+		if (cameraIndex >= _cameraCores.size()) return false;
+
+		return PinCurrentThread(_cameraCores[cameraIndex]);
+	}
+
+	bool ThreadPlacement::PinGeneralThread()
+	{
+		if (!_active) return false;
+
+		return PinCurrentThread(_active->_generalCores);
+	}
+
+	bool ThreadPlacement::PinCurrentThread(const std::vector<unsigned int>& cores)
+	{
+		// a mask per group, of the listed cores that exist - the thread goes to the group with most of them
+		std::vector<KAFFINITY> masks(GetActiveProcessorGroupCount(), 0);
+		std::vector<unsigned int> counts(masks.size(), 0);
+		std::vector<PROCESSOR_NUMBER> firstProcessors(masks.size());
+		PROCESSOR_NUMBER processor;
+		for (unsigned int core : cores)
+		{
+			if (!ToProcessorNumber(core, processor) || (masks[processor.Group] & ((KAFFINITY)1 << processor.Number))) continue;
+			if (counts[processor.Group]++ == 0) firstProcessors[processor.Group] = processor;
+			masks[processor.Group] |= (KAFFINITY)1 << processor.Number;
+		}
+
+		WORD group = (WORD)(std::max_element(counts.begin(), counts.end()) - counts.begin());
+		if (counts.empty() || counts[group] == 0) return false;
+
+		GROUP_AFFINITY affinity;
+		ZeroMemory(&affinity, sizeof(affinity));
+		affinity.Group = group;
+		affinity.Mask = masks[group];
+		if (!SetThreadGroupAffinity(GetCurrentThread(), &affinity, NULL))
+			return false;
+
+		// start out on the first core, the scheduler only moves the thread within the mask if that core is busy
+		SetThreadIdealProcessorEx(GetCurrentThread(), &firstProcessors[group], NULL);
+		Sleep(0); // give the scheduler a chance to migrate us before anything gets allocated
+
+		return true;
+	}
+
+	std::string ThreadPlacement::DescribeCurrentThread()
+	{
+		GROUP_AFFINITY affinity;
+		PROCESSOR_NUMBER processor;
+		USHORT node = 0;
+
+		GetThreadGroupAffinity(GetCurrentThread(), &affinity);
+		GetCurrentProcessorNumberEx(&processor);
+		GetNumaProcessorNodeEx(&processor, &node);
+
+		std::ostringstream description;
+		description << "group " << affinity.Group << ", affinity mask 0x" << std::hex << affinity.Mask << std::dec
+			<< ", running on core " << ToCoreIndex(processor) << " (NUMA node " << node << ")";
+		return description.str();
+	}
+
+	bool ThreadPlacement::ToProcessorNumber(unsigned int core, PROCESSOR_NUMBER& processor)
+	{
+		WORD groupCount = GetActiveProcessorGroupCount();
+		for (WORD group = 0; group < groupCount; group++)
+		{
+			DWORD groupSize = GetActiveProcessorCount(group);
+			if (core < groupSize)
+			{
+				processor.Group = group;
+				processor.Number = (BYTE)core;
+				processor.Reserved = 0;
+				return true;
+			}
+			core -= groupSize;
+		}
+
+		return false;
+	}
+
+	unsigned int ThreadPlacement::ToCoreIndex(const PROCESSOR_NUMBER& processor)
+	{
+		unsigned int core = processor.Number;
+		for (WORD group = 0; group < processor.Group; group++) core += GetActiveProcessorCount(group);
+		return core;
+	}
+
+	void* AllocateNodeLocal(size_t bytes)
+	{
+		PROCESSOR_NUMBER processor;
+		USHORT node;
+		GetCurrentProcessorNumberEx(&processor);
+
+		void* memory = NULL;
+		if (GetNumaProcessorNodeEx(&processor, &node))
+			memory = VirtualAllocExNuma(GetCurrentProcess(), NULL, bytes, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE, node);
+		else
+			memory = VirtualAlloc(NULL, bytes, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE);
+
+		if (!memory) throw std::runtime_error("Failed to allocate " + std::to_string(bytes) + " bytes");
+		return memory;
+	}
+
+	void FreeNodeLocal(void* memory)
+	{
+		if (memory) VirtualFree(memory, 0, MEM_RELEASE);
+	}
+}
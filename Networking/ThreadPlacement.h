@@ -0,0 +1,43 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <winsock2.h> // must precede windows.h
+#include <windows.h>
+
+namespace Networking
+{
+	// pins the threads of each camera to a set of cores, and everything else (GUI, recording, background work) to the remaining ones
+	// the placement is read from a file (see Load), so that it can be tuned per deployment. Cores are numbered globally, group after
+	// group: Windows may form groups of fewer than 64 processors (e.g. 2 x 40 on a dual socket machine), so core i is found by walking
+	// the groups' sizes. All cores of a camera must be in the same processor group; a thread can't span groups, so the general threads
+	// are pinned to the group that holds most of the general cores.
+	class ThreadPlacement
+	{
+		std::vector<std::vector<unsigned int>> _cameraCores; // indexed by camera
+		std::vector<unsigned int> _generalCores;
+
+		static const ThreadPlacement* _active; // the placement used by PinGeneralThread, NULL if none was loaded
+
+	public:
+		// expects a cv::FileStorage file (.xml/.yml) with a sequence of core lists named "Cameras" (one per camera) and
+		// an optional core list named "GeneralCores" (by default - every core not assigned to a camera)
+		static ThreadPlacement Load(const std::string& path);
+		void Activate() const; // makes this placement the one used by PinGeneralThread
+
+		bool PinCameraThread(unsigned int cameraIndex) const; // pins the calling thread (returns false if the camera has no cores or pinning failed)
+		static bool PinGeneralThread(); // pins the calling thread to the general cores of the active placement (no-op without one)
+
+		static std::string DescribeCurrentThread(); // processor group, affinity mask, current core and its NUMA node
+
+	private:
+		static bool PinCurrentThread(const std::vector<unsigned int>& cores); // never throws - cores that don't exist are ignored
+		static bool ToProcessorNumber(unsigned int core, PROCESSOR_NUMBER& processor); // false if there is no such core
+		static unsigned int ToCoreIndex(const PROCESSOR_NUMBER& processor);
+	};
+
+	// allocates memory on the NUMA node of the core the calling thread is running on (call after pinning the thread)
+	// memory obtained this way must be released with FreeNodeLocal
+	void* AllocateNodeLocal(size_t bytes);
+	void FreeNodeLocal(void* memory);
+}
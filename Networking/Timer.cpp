@@ -28,8 +28,9 @@ void Timer::IterationStarted(int index)
 	}
 }
 
-void Timer::IterationEnded(size_t numBytesMoved)
+bool Timer::IterationEnded(size_t numBytesMoved)
 {
+	bool printed = false;
 	if (_insideIteration)
 	{
 		_accumulatedBytes += numBytesMoved;
@@ -46,10 +47,13 @@ void Timer::IterationEnded(size_t numBytesMoved)
 			_accumulatedBytes = 0;
 			_sampleCounter = 0;
 			_windowsCounter++;
+			printed = true;
 		}
 
 		_insideIteration = false;
 	}
+
+	return printed;
 }
 
 float Timer::TimeSinceFirstIteration()
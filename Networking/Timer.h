@@ -15,7 +15,7 @@ public:
 	Timer(string name, int windowSize);
 
 	void  IterationStarted(int index);
-	void  IterationEnded(size_t numBytesMoved);
+	bool  IterationEnded(size_t numBytesMoved); // returns true when it printed the telemetry of a window
 	float TimeSinceFirstIteration();
 	float AverageBandwidth(); // returns the average bit rate during the session, in units of [Mbps]
 
@@ -0,0 +1,367 @@
+#include "TsdfVolume.h"
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+#include <stdio.h>
+
+namespace Networking
+{
+	const float MaximalWeight = 64.f; // a voxel averages its last ~64 observations, so the volume still follows slow changes
+	const int AllocationStride = 2; // [pixels], every other pixel of every other row allocates blocks - a block spans many pixels anyway
+
+	static long long PackBlockPosition(int x, int y, int z)
+	{
+		const long long mask = (1 << 21) - 1; // 21 bits per axis - +-1M blocks, far more than any room
+		return ((x & mask) << 42) | ((y & mask) << 21) | (z & mask);
+	}
+
+	static cv::Vec3i FloorDivide(cv::Vec3i value, int divisor)
+	{
+		cv::Vec3i result;
+		for (int i = 0; i < 3; i++) result[i] = value[i] >= 0 ? value[i] / divisor : -((-value[i] + divisor - 1) / divisor);
+		return result;
+	}
+
+	static cv::Matx44f Inverse(const cv::Matx44f& rigidTransform)
+	{
+		cv::Matx33f rotation = rigidTransform.get_minor<3, 3>(0, 0).t();
+		cv::Vec3f translation = -(rotation * cv::Vec3f(rigidTransform(0, 3), rigidTransform(1, 3), rigidTransform(2, 3)));
+		return cv::Matx44f(rotation(0, 0), rotation(0, 1), rotation(0, 2), translation[0],
+			rotation(1, 0), rotation(1, 1), rotation(1, 2), translation[1],
+			rotation(2, 0), rotation(2, 1), rotation(2, 2), translation[2],
+			0, 0, 0, 1);
+	}
+
+	// finds the blocks within the truncation band around the depth of each row's pixels
+	class RowBlockFinder : public cv::ParallelLoopBody
+	{
+		TsdfVolume& _volume;
+		const cv::Mat& _depth;
+		cv::Matx33f _intrinsics;
+		cv::Matx44f _cameraToWorld;
+
+	public:
+		RowBlockFinder(TsdfVolume& volume, const cv::Mat& depth, const cv::Matx33f& intrinsics, const cv::Matx44f& cameraToWorld) :
+			_volume(volume), _depth(depth), _intrinsics(intrinsics), _cameraToWorld(cameraToWorld) {}
+
+		void operator()(const cv::Range& rows) const
+		{
+			float blockSize = _volume._voxelSize * TsdfVolume::BlockSize;
+			cv::Matx33f rotation = _cameraToWorld.get_minor<3, 3>(0, 0);
+			cv::Vec3f origin(_cameraToWorld(0, 3), _cameraToWorld(1, 3), _cameraToWorld(2, 3));
+
+			for (int row = rows.start; row < rows.end; row++)
+			{
+				std::vector<long long>& blocks = _volume._rowBlocks[row];
+				blocks.clear();
+				if (row % AllocationStride) continue;
+
+				const unsigned short* depth = _depth.ptr<unsigned short>(row);
+				for (int column = 0; column < _depth.cols; column += AllocationStride)
+				{
+					if (depth[column] == 0) continue;
+
+					// from truncation in front of the surface to truncation behind it, half a block at a time along the ray (z - depth)
+					cv::Vec3f ray = rotation * cv::Vec3f((column - _intrinsics(0, 2)) / _intrinsics(0, 0), (row - _intrinsics(1, 2)) / _intrinsics(1, 1), 1);
+					float step = blockSize / 2 / (float)cv::norm(ray);
+					float last = depth[column] + _volume._truncation;
+					for (float z = std::max(depth[column] - _volume._truncation, step); ; z = std::min(z + step, last))
+					{
+						cv::Vec3f point = origin + ray * z;
+						long long block = PackBlockPosition((int)std::floor(point[0] / blockSize), (int)std::floor(point[1] / blockSize), (int)std::floor(point[2] / blockSize));
+						if (blocks.empty() || blocks.back() != block) blocks.push_back(block); // neighbouring steps and pixels mostly share blocks
+						if (z == last) break;
+					}
+				}
+			}
+		}
+	};
+
+	// updates the voxels of the touched blocks from the depth frame
+	class BlockIntegrator : public cv::ParallelLoopBody
+	{
+		TsdfVolume& _volume;
+		const cv::Mat& _depth;
+		cv::Matx33f _intrinsics;
+		cv::Matx44f _worldToCamera;
+
+	public:
+		BlockIntegrator(TsdfVolume& volume, const cv::Mat& depth, const cv::Matx33f& intrinsics, const cv::Matx44f& worldToCamera) :
+			_volume(volume), _depth(depth), _intrinsics(intrinsics), _worldToCamera(worldToCamera) {}
+
+		void operator()(const cv::Range& blocks) const
+		{
+			const float voxelSize = _volume._voxelSize, truncation = _volume._truncation;
+			const float fx = _intrinsics(0, 0), fy = _intrinsics(1, 1), cx = _intrinsics(0, 2), cy = _intrinsics(1, 2);
+			cv::Matx33f rotation = _worldToCamera.get_minor<3, 3>(0, 0);
+			cv::Vec3f translation(_worldToCamera(0, 3), _worldToCamera(1, 3), _worldToCamera(2, 3));
+			cv::Vec3f xStep = rotation * cv::Vec3f(voxelSize, 0, 0); // the transform is affine - walking along x is an addition
+
+			for (int blockIndex = blocks.start; blockIndex < blocks.end; blockIndex++)
+			{
+				TsdfVolume::Block& block = *_volume._touchedBlocks[blockIndex];
+				TsdfVolume::Voxel* voxel = block.Voxels;
+				cv::Vec3f blockOrigin = cv::Vec3f((float)block.Position[0], (float)block.Position[1], (float)block.Position[2]) * (voxelSize * TsdfVolume::BlockSize);
+
+				for (int z = 0; z < TsdfVolume::BlockSize; z++)
+					for (int y = 0; y < TsdfVolume::BlockSize; y++)
+					{
+						cv::Vec3f camera = rotation * (blockOrigin + cv::Vec3f(0.5f, y + 0.5f, z + 0.5f) * voxelSize) + translation; // voxel centres
+						for (int x = 0; x < TsdfVolume::BlockSize; x++, voxel++, camera += xStep)
+						{
+							if (camera[2] <= 0) continue;
+							int u = cvRound(fx * camera[0] / camera[2] + cx), v = cvRound(fy * camera[1] / camera[2] + cy);
+							if (u < 0 || v < 0 || u >= _depth.cols || v >= _depth.rows) continue;
+
+							unsigned short depth = _depth.at<unsigned short>(v, u);
+							if (depth == 0) continue;
+							float distance = depth - camera[2]; // along the optical axis - the usual projective approximation
+							if (distance < -truncation) continue; // hidden behind the surface
+
+							float truncated = std::min(1.f, distance / truncation);
+							voxel->Distance = (voxel->Distance * voxel->Weight + truncated) / (voxel->Weight + 1);
+							voxel->Weight = std::min(voxel->Weight + 1, MaximalWeight);
+						}
+					}
+			}
+		}
+	};
+
+	// collects the zero crossings between each voxel and its +x, +y and +z neighbours
+	class SurfaceExtractor : public cv::ParallelLoopBody
+	{
+		const TsdfVolume& _volume;
+		const std::vector<const TsdfVolume::Block*>& _blocks;
+		std::vector<std::vector<cv::Point3f>>& _points; // by block
+
+	public:
+		SurfaceExtractor(const TsdfVolume& volume, const std::vector<const TsdfVolume::Block*>& blocks, std::vector<std::vector<cv::Point3f>>& points) :
+			_volume(volume), _blocks(blocks), _points(points) {}
+
+		void operator()(const cv::Range& blocks) const
+		{
+			const int size = TsdfVolume::BlockSize;
+			for (int blockIndex = blocks.start; blockIndex < blocks.end; blockIndex++)
+			{
+				const TsdfVolume::Block& block = *_blocks[blockIndex];
+				std::vector<cv::Point3f>& points = _points[blockIndex];
+				cv::Vec3i firstVoxel = block.Position * size;
+
+				for (int z = 0; z < size; z++)
+					for (int y = 0; y < size; y++)
+						for (int x = 0; x < size; x++)
+						{
+							const TsdfVolume::Voxel& voxel = block.Voxels[(z * size + y) * size + x];
+							if (voxel.Weight == 0) continue;
+
+							for (int axis = 0; axis < 3; axis++)
+							{
+								cv::Vec3i position(x, y, z);
+								position[axis]++;
+								const TsdfVolume::Voxel* neighbour = position[axis] < size ? &block.Voxels[(position[2] * size + position[1]) * size + position[0]] :
+									_volume.FindVoxel(firstVoxel + position);
+								if (!neighbour || neighbour->Weight == 0 || (voxel.Distance > 0) == (neighbour->Distance > 0)) continue;
+
+								float t = voxel.Distance / (voxel.Distance - neighbour->Distance); // where the interpolated distance is zero
+								cv::Vec3f point(firstVoxel[0] + x + 0.5f, firstVoxel[1] + y + 0.5f, firstVoxel[2] + z + 0.5f);
+								point[axis] += t;
+								points.push_back(cv::Point3f(point * _volume._voxelSize));
+							}
+						}
+			}
+		}
+	};
+
+	TsdfVolume::TsdfVolume(float voxelSize, float truncation, size_t maximalBlocks, unsigned int evictionAge) : _voxelSize(voxelSize), _truncation(truncation),
+		_maximalBlocks(maximalBlocks), _evictionAge(evictionAge), _evictedBlocks(0), _droppedBlocks(0), _frames(0)
+	{
+		if (_maximalBlocks == 0 || _evictionAge == 0) throw std::runtime_error("The reconstruction needs a block budget and an eviction age");
+		InitializeCriticalSection(&_lock);
+	}
+
+	TsdfVolume::~TsdfVolume()
+	{
+		DeleteCriticalSection(&_lock);
+	}
+
+	void TsdfVolume::Integrate(const cv::Mat& depth, const cv::Matx33f& intrinsics, const cv::Matx44f& cameraToWorld)
+	{
+		CV_Assert(depth.type() == CV_16UC1);
+
+		EnterCriticalSection(&_lock);
+
+		_frames++;
+		AllocateBlocks(depth, intrinsics, cameraToWorld);
+		cv::parallel_for_(cv::Range(0, (int)_touchedBlocks.size()), BlockIntegrator(*this, depth, intrinsics, Inverse(cameraToWorld)));
+
+		LeaveCriticalSection(&_lock);
+	}
+
+	void TsdfVolume::AllocateBlocks(const cv::Mat& depth, const cv::Matx33f& intrinsics, const cv::Matx44f& cameraToWorld)
+	{
+		_rowBlocks.resize(depth.rows);
+		cv::parallel_for_(cv::Range(0, depth.rows), RowBlockFinder(*this, depth, intrinsics, cameraToWorld));
+
+		// the rows overlap a lot - LastFrame makes sure every block is integrated once
+		_touchedBlocks.clear();
+		bool evicted = false; // at most once an integration - if nothing was stale, nothing will be until the next one
+		for (auto& row : _rowBlocks)
+			for (long long packedPosition : row)
+			{
+				auto found = _blockIndex.find(packedPosition);
+				Block* block = found != _blockIndex.end() ? found->second : NULL;
+				if (!block)
+				{
+					block = AllocateBlock(evicted);
+					if (!block) continue;
+
+					_blockIndex[packedPosition] = block;
+					const int mask = (1 << 21) - 1, signBit = 1 << 20;
+					int x = (int)(packedPosition >> 42) & mask, y = (int)(packedPosition >> 21) & mask, z = (int)packedPosition & mask;
+					block->Position = cv::Vec3i(x & signBit ? x - (1 << 21) : x, y & signBit ? y - (1 << 21) : y, z & signBit ? z - (1 << 21) : z);
+				}
+
+				if (block->LastFrame == _frames) continue;
+				block->LastFrame = _frames;
+				_touchedBlocks.push_back(block);
+			}
+	}
+
+	TsdfVolume::Block* TsdfVolume::AllocateBlock(bool& evicted)
+	{
+		if (_blockIndex.size() >= _maximalBlocks)
+		{
+			if (!evicted) EvictStaleBlocks();
+			evicted = true;
+
+			if (_blockIndex.size() >= _maximalBlocks)
+			{
+				_droppedBlocks++;
+				return NULL;
+			}
+		}
+
+		if (_freeBlocks.empty())
+		{
+			_blocks.emplace_back(); // value initialized - never observed, never integrated
+			return &_blocks.back();
+		}
+
+		Block* block = _freeBlocks.back();
+		_freeBlocks.pop_back();
+		*block = Block();
+		return block;
+	}
+
+	void TsdfVolume::EvictStaleBlocks()
+	{
+		for (auto block = _blockIndex.begin(); block != _blockIndex.end();)
+		{
+			if (_frames - block->second->LastFrame <= _evictionAge) // blocks of the current integration are never stale
+			{
+				++block;
+				continue;
+			}
+
+			_freeBlocks.push_back(block->second);
+			block = _blockIndex.erase(block);
+			_evictedBlocks++;
+		}
+	}
+
+	const TsdfVolume::Voxel* TsdfVolume::FindVoxel(cv::Vec3i voxel) const
+	{
+		cv::Vec3i blockPosition = FloorDivide(voxel, BlockSize);
+		auto block = _blockIndex.find(PackBlockPosition(blockPosition[0], blockPosition[1], blockPosition[2]));
+		if (block == _blockIndex.end()) return NULL;
+
+		cv::Vec3i inBlock = voxel - blockPosition * BlockSize;
+		return &block->second->Voxels[(inBlock[2] * BlockSize + inBlock[1]) * BlockSize + inBlock[0]];
+	}
+
+	void TsdfVolume::ExtractSurface(std::vector<cv::Point3f>& points) const
+	{
+		EnterCriticalSection(&_lock); // the cameras' integrations wait meanwhile
+
+		std::vector<const Block*> blocks;
+		for (auto& block : _blockIndex) blocks.push_back(block.second);
+		std::vector<std::vector<cv::Point3f>> blockPoints(blocks.size());
+		cv::parallel_for_(cv::Range(0, (int)blocks.size()), SurfaceExtractor(*this, blocks, blockPoints));
+
+		LeaveCriticalSection(&_lock);
+
+		points.clear();
+		for (auto& block : blockPoints) points.insert(points.end(), block.begin(), block.end());
+	}
+
+	bool TsdfVolume::SavePly(const std::string& fileName) const
+	{
+		std::vector<cv::Point3f> points;
+		ExtractSurface(points);
+
+		FILE* file = NULL;
+		if (fopen_s(&file, fileName.c_str(), "wb") != 0 || !file) return false;
+
+		fprintf(file, "ply\nformat binary_little_endian 1.0\ncomment TSDF surface, mm, camera 0 coordinates\nelement vertex %d\n"
+			"property float x\nproperty float y\nproperty float z\nend_header\n", (int)points.size());
+		if (!points.empty()) fwrite(&points[0], sizeof(cv::Point3f), points.size(), file);
+		fclose(file);
+
+		return true;
+	}
+
+	size_t TsdfVolume::BlockCount() const
+	{
+		EnterCriticalSection(&_lock);
+		size_t count = _blockIndex.size();
+		LeaveCriticalSection(&_lock);
+
+		return count;
+	}
+
+	std::string TsdfVolume::ToString() const
+	{
+		EnterCriticalSection(&_lock);
+		size_t blocks = _blockIndex.size(), allocated = _blocks.size();
+		unsigned int evictedBlocks = _evictedBlocks, droppedBlocks = _droppedBlocks;
+		LeaveCriticalSection(&_lock);
+
+		char description[256];
+		sprintf_s(description, "%d of %d blocks in use (%2.1f [MB] allocated), %u evicted, %u dropped, voxel %2.1f [mm], truncation %2.1f [mm]",
+			(int)blocks, (int)_maximalBlocks, allocated * sizeof(Block) / 1e6, evictedBlocks, droppedBlocks, _voxelSize, _truncation);
+
+		return description;
+	}
+
+	bool TsdfVolume::LoadCamera(const std::string& calibrationFile, unsigned int cameraIndex, cv::Matx33f& intrinsics, cv::Matx44f& cameraToWorld)
+	{
+		cv::FileStorage fileStorage(calibrationFile, cv::FileStorage::READ);
+		if (!fileStorage.isOpened() || cameraIndex > 1 || fileStorage["CameraMatrix_" + std::to_string(cameraIndex)].isNone()) return false;
+
+		cv::Mat cameraMatrix;
+		fileStorage["CameraMatrix_" + std::to_string(cameraIndex)] >> cameraMatrix;
+		cameraMatrix.convertTo(cameraMatrix, CV_32F);
+		intrinsics = cv::Matx33f((float*)cameraMatrix.data);
+
+		cameraToWorld = cv::Matx44f::eye();
+		if (cameraIndex == 0) return true;
+
+		// stereoCalibrate's R, T take camera 0 coordinates to camera 1 coordinates
+		cv::Mat rotation, translation;
+		fileStorage["Rotation"] >> rotation;
+		fileStorage["Translation"] >> translation;
+		if (rotation.empty() || translation.empty()) return false;
+		rotation.convertTo(rotation, CV_32F);
+		translation.convertTo(translation, CV_32F);
+
+		cv::Matx44f worldToCamera = cv::Matx44f::eye();
+		for (int row = 0; row < 3; row++)
+		{
+			for (int column = 0; column < 3; column++) worldToCamera(row, column) = rotation.at<float>(row, column);
+			worldToCamera(row, 3) = translation.at<float>(row);
+		}
+		cameraToWorld = Inverse(worldToCamera);
+
+		return true;
+	}
+}
@@ -0,0 +1,81 @@
+#pragma once
+
+#include <opencv2/core/core.hpp>
+#include <deque>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include <windows.h>
+
+namespace Networking
+{
+	// fuses depth frames from calibrated cameras into a truncated signed distance function (TSDF) of the scene, a la KinectFusion
+	// only the space near observed surfaces is stored: the volume is a hash of blocks of 8x8x8 voxels, allocated as depth first falls
+	// into them. Every frame updates the blocks its depth touched, spread over all cores (cv::parallel_for_, one block at a time).
+	// The surface is extracted on demand, as the points where the distance changes sign between neighbouring voxels.
+	// A block takes ~4 KB, so the volume holds at most maximalBlocks of them: once they're all in use, the blocks no integration has
+	// touched for evictionAge integrations are freed for reuse (forgetting that part of the scene), and if none are that old, new depth
+	// outside the allocated blocks is dropped until some are. ToString reports how many were evicted and dropped.
+	// Thread safe - each camera thread integrates its own frames (one at a time), extraction may run on another thread meanwhile.
+	// World coordinates are those of camera 0, in mm.
+	class TsdfVolume
+	{
+	public:
+		static const int BlockSize = 8; // [voxels] along each axis
+
+		struct Voxel
+		{
+			float Distance; // truncated and normalized to [-1, 1], positive in front of the surface
+			float Weight; // zero - never observed
+		};
+
+		struct Block
+		{
+			cv::Vec3i Position; // [blocks]
+			unsigned int LastFrame; // the last integration that touched the block
+			Voxel Voxels[BlockSize * BlockSize * BlockSize]; // x fastest, then y, then z
+		};
+
+	private:
+		float _voxelSize; // [mm]
+		float _truncation; // [mm]
+		std::deque<Block> _blocks; // a deque - blocks never move, however many are added
+		std::unordered_map<long long, Block*> _blockIndex; // by packed position, the blocks in use
+		std::vector<Block*> _freeBlocks; // evicted, to be reused before the deque grows
+		size_t _maximalBlocks;
+		unsigned int _evictionAge; // [integrations]
+		unsigned int _evictedBlocks;
+		unsigned int _droppedBlocks; // allocations refused for lack of room - once per depth row the block falls into
+		std::vector<Block*> _touchedBlocks; // by the current integration
+		std::vector<std::vector<long long>> _rowBlocks; // the blocks each depth row falls into, kept to avoid reallocation every frame
+		unsigned int _frames;
+		mutable CRITICAL_SECTION _lock;
+
+	public:
+		TsdfVolume(float voxelSize, float truncation, size_t maximalBlocks, unsigned int evictionAge); // [mm], [mm], [blocks], [integrations]
+		~TsdfVolume();
+
+		// depth in mm (CV_16UC1, zero - invalid), from a camera with these intrinsics and pose (camera to world); undistorted depth fuses best
+		void Integrate(const cv::Mat& depth, const cv::Matx33f& intrinsics, const cv::Matx44f& cameraToWorld);
+
+		void ExtractSurface(std::vector<cv::Point3f>& points) const; // [mm], world coordinates
+		bool SavePly(const std::string& fileName) const; // the extracted surface, as a point cloud
+
+		size_t BlockCount() const; // in use
+		std::string ToString() const;
+
+		// reads a camera's intrinsics and pose from the file CameraCalibrator writes (camera 0 defines the world; camera 1 is placed by the
+		// stereo extrinsics); false if the file doesn't cover the camera
+		static bool LoadCamera(const std::string& calibrationFile, unsigned int cameraIndex, cv::Matx33f& intrinsics, cv::Matx44f& cameraToWorld);
+
+	private:
+		void AllocateBlocks(const cv::Mat& depth, const cv::Matx33f& intrinsics, const cv::Matx44f& cameraToWorld);
+		Block* AllocateBlock(bool& evicted); // NULL if the budget is used up
+		void EvictStaleBlocks();
+		const Voxel* FindVoxel(cv::Vec3i voxel) const; // NULL if its block isn't allocated
+
+		friend class BlockIntegrator;
+		friend class RowBlockFinder;
+		friend class SurfaceExtractor;
+	};
+}
@@ -0,0 +1,71 @@
+#include "UndistortionStage.h"
+#include <opencv2/imgproc/imgproc.hpp>
+#include <opencv2/calib3d/calib3d.hpp>
+
+namespace Networking
+{
+	UndistortionStage::UndistortionStage(const ChannelProperties* channelProperties, const cv::Mat& cameraMatrix, const cv::Mat& distortion,
+		const cv::Mat& rectification, const cv::Mat& projection) :
+		_interpolation(channelProperties->ChannelType == ChannelType::Depth ? cv::INTER_NEAREST : cv::INTER_LINEAR),
+		_output(channelProperties->Height, channelProperties->Width, channelProperties->PixelType)
+	{
+		cv::Size size(channelProperties->Width, channelProperties->Height);
+		cv::Mat newCameraMatrix = projection.empty() ? cameraMatrix : projection;
+		newCameraMatrix(cv::Rect(0, 0, 3, 3)).convertTo(_outputCameraMatrix, CV_32F); // a projection's fourth column only holds the baseline
+		if (rectification.empty()) _rectification = cv::Matx33f::eye();
+		else rectification.convertTo(_rectification, CV_32F);
+
+		if (_interpolation == cv::INTER_NEAREST)
+		{
+			// rounded to whole pixels up front, so remap doesn't even look up an interpolation table
+			cv::Mat mapX, mapY;
+			cv::initUndistortRectifyMap(cameraMatrix, distortion, rectification, newCameraMatrix, size, CV_32FC1, mapX, mapY);
+			cv::convertMaps(mapX, mapY, _map1, _map2, CV_16SC2, true);
+		}
+		else
+		{
+			cv::initUndistortRectifyMap(cameraMatrix, distortion, rectification, newCameraMatrix, size, CV_16SC2, _map1, _map2);
+		}
+	}
+
+	UndistortionStage* UndistortionStage::Load(const std::string& calibrationFile, unsigned int cameraIndex, const ChannelProperties* channelProperties, bool rectify)
+	{
+		cv::FileStorage fileStorage(calibrationFile, cv::FileStorage::READ);
+		if (!fileStorage.isOpened()) throw std::runtime_error("Could not open file " + calibrationFile);
+
+		std::string camera = std::to_string(cameraIndex);
+		if (fileStorage["CameraMatrix_" + camera].isNone()) throw std::runtime_error(calibrationFile + " has no calibration for camera " + camera);
+
+		int width, height;
+		fileStorage["ImageWidth"] >> width;
+		fileStorage["ImageHeight"] >> height;
+		if (width != (int)channelProperties->Width || height != (int)channelProperties->Height) return NULL;
+
+		cv::Mat cameraMatrix, distortion;
+		fileStorage["CameraMatrix_" + camera] >> cameraMatrix;
+		fileStorage["DistortionCoefficients_" + camera] >> distortion;
+		if (!rectify || cameraIndex > 1) return new UndistortionStage(channelProperties, cameraMatrix, distortion);
+
+		// both cameras of the pair come up with the same rectification, each keeping its own half
+		cv::Mat cameraMatrices[2], distortions[2], rotation, translation;
+		for (int i = 0; i < 2; i++)
+		{
+			fileStorage["CameraMatrix_" + std::to_string(i)] >> cameraMatrices[i];
+			fileStorage["DistortionCoefficients_" + std::to_string(i)] >> distortions[i];
+		}
+		fileStorage["Rotation"] >> rotation;
+		fileStorage["Translation"] >> translation;
+
+		cv::Mat rectifications[2], projections[2], disparityToDepth;
+		cv::stereoRectify(cameraMatrices[0], distortions[0], cameraMatrices[1], distortions[1], cv::Size(width, height), rotation, translation,
+			rectifications[0], rectifications[1], projections[0], projections[1], disparityToDepth, cv::CALIB_ZERO_DISPARITY, 0); // 0 - only valid pixels in view
+
+		return new UndistortionStage(channelProperties, cameraMatrix, distortion, rectifications[cameraIndex], projections[cameraIndex]);
+	}
+
+	const cv::Mat& UndistortionStage::Apply(const cv::Mat& frame)
+	{
+		cv::remap(frame, _output, _map1, _map2, _interpolation, cv::BORDER_CONSTANT, cv::Scalar(0)); // zero - invalid depth, black elsewhere
+		return _output;
+	}
+}
@@ -0,0 +1,38 @@
+#pragma once
+
+#include "ChannelProperties.h"
+#include <opencv2/core/core.hpp>
+#include <string>
+
+namespace Networking
+{
+	// removes the lens distortion from a camera's frames (and optionally rectifies a stereo pair), with remap tables built once
+	// the tables are fixed point (CV_16SC2 + CV_16UC1 interpolation indices), which remap applies several times faster than floating point
+	// ones, on all cores. Depth is remapped nearest neighbour, so invalid (zero) pixels are never blended into valid ones.
+	// The output goes into a buffer of the stage's own, reused from frame to frame.
+	class UndistortionStage
+	{
+		cv::Mat _map1, _map2; // _map2 is empty for nearest neighbour - the rounded coordinates are all there is
+		int _interpolation;
+		cv::Mat _output;
+		cv::Matx33f _outputCameraMatrix;
+		cv::Matx33f _rectification;
+
+	public:
+		// cameraMatrix, distortion - of the channel, at its resolution. rectification, projection - of the camera in a rectified stereo
+		// pair (see stereoRectify), or empty to keep the camera's orientation and intrinsics
+		UndistortionStage(const ChannelProperties* channelProperties, const cv::Mat& cameraMatrix, const cv::Mat& distortion,
+			const cv::Mat& rectification = cv::Mat(), const cv::Mat& projection = cv::Mat());
+
+		// reads the file CameraCalibrator writes; rectify - for cameras 0 and 1, the stereo pair the file has the extrinsics of.
+		// NULL if the calibration is of a channel with another resolution (e.g. IR/depth calibration and a color channel)
+		static UndistortionStage* Load(const std::string& calibrationFile, unsigned int cameraIndex, const ChannelProperties* channelProperties, bool rectify);
+
+		const cv::Mat& Apply(const cv::Mat& frame); // valid until the next call
+
+		// what the output frames are in: their intrinsics, and the rotation from the camera's own coordinates to theirs (x_rectified =
+		// Rectification * x_camera, the identity unless rectified) - whatever projects the frames into 3D must use these, not the calibration's
+		const cv::Matx33f& OutputCameraMatrix() const { return _outputCameraMatrix; }
+		const cv::Matx33f& Rectification() const { return _rectification; }
+	};
+}
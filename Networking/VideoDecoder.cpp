@@ -0,0 +1,139 @@
+#include "VideoDecoder.h"
+#include <stdexcept>
+#include <algorithm>
+
+#ifdef KINECT_CLIENT_WITH_FFMPEG
+extern "C"
+{
+#include <libavcodec/avcodec.h>
+#include <libswscale/swscale.h>
+}
+#endif
+
+namespace Networking
+{
+	const int H264IdrSlice = 5; // NAL unit types marking a keyframe
+	const int H264SequenceParameterSet = 7;
+	const int HevcFirstIrapSlice = 16; // BLA, IDR and CRA slices are 16-21
+	const int HevcLastIrapSlice = 21;
+	const int HevcVideoParameterSet = 32;
+
+	bool VideoDecoder::IsKeyframe(const std::vector<unsigned char>& payload, enum ChannelType channelType)
+	{
+		// Annex B - NAL units are preceded by 00 00 01 (or 00 00 00 01)
+		for (size_t i = 0; i + 3 < payload.size(); i++)
+		{
+			if (payload[i] != 0 || payload[i + 1] != 0 || payload[i + 2] != 1) continue;
+
+			unsigned char header = payload[i + 3];
+			if (channelType == ChannelType::ColorH264)
+			{
+				int type = header & 0x1F;
+				if (type == H264IdrSlice || type == H264SequenceParameterSet) return true;
+			}
+			else
+			{
+				int type = (header >> 1) & 0x3F;
+				if ((type >= HevcFirstIrapSlice && type <= HevcLastIrapSlice) || type == HevcVideoParameterSet) return true;
+			}
+			i += 2;
+		}
+
+		return false;
+	}
+
+#ifdef KINECT_CLIENT_WITH_FFMPEG
+
+	VideoDecoder::VideoDecoder(const ChannelProperties* channelProperties) : _channelProperties(channelProperties), _context(NULL), _frame(NULL), _packet(NULL), _converter(NULL),
+		_waitingForKeyframe(true)
+	{
+		AVCodec* codec = avcodec_find_decoder(channelProperties->ChannelType == ChannelType::ColorH264 ? AV_CODEC_ID_H264 : AV_CODEC_ID_HEVC);
+		if (!codec) throw std::runtime_error("FFmpeg was built without a decoder for " + channelProperties->ToString());
+
+		_context = avcodec_alloc_context3(codec);
+		_context->thread_count = 0; // one per core
+		_context->thread_type = FF_THREAD_SLICE;
+		_context->flags |= AV_CODEC_FLAG_LOW_DELAY;
+		if (avcodec_open2(_context, codec, NULL) < 0) throw std::runtime_error("Failed to open the decoder for " + channelProperties->ToString());
+
+		_frame = av_frame_alloc();
+		_packet = av_packet_alloc();
+	}
+
+	VideoDecoder::~VideoDecoder()
+	{
+		sws_freeContext(_converter);
+		av_packet_free(&_packet);
+		av_frame_free(&_frame);
+		avcodec_free_context(&_context);
+	}
+
+	bool VideoDecoder::Decode(const std::vector<unsigned char>& payload, cv::Mat* output)
+	{
+		if (_waitingForKeyframe)
+		{
+			if (!IsKeyframe(payload, _channelProperties->ChannelType)) return false;
+			_waitingForKeyframe = false;
+		}
+
+		// the bitstream readers read past the end of the data, up to AV_INPUT_BUFFER_PADDING_SIZE bytes, which must be zero - the
+		// payload's vector has no such room, so it is copied (the buffer grows to the largest packet seen, then stays allocated)
+		if (_paddedPayload.size() < payload.size() + AV_INPUT_BUFFER_PADDING_SIZE) _paddedPayload.resize(payload.size() + AV_INPUT_BUFFER_PADDING_SIZE);
+		std::copy(payload.begin(), payload.end(), _paddedPayload.begin());
+		std::fill(_paddedPayload.begin() + payload.size(), _paddedPayload.begin() + payload.size() + AV_INPUT_BUFFER_PADDING_SIZE, 0);
+
+		_packet->data = _paddedPayload.data();
+		_packet->size = (int)payload.size();
+		if (avcodec_send_packet(_context, _packet) < 0)
+		{
+			Reset(); // a corrupt packet leaves the references broken until the next keyframe
+			return false;
+		}
+
+		bool decoded = false;
+		while (avcodec_receive_frame(_context, _frame) == 0) // with low delay and no B-frames, one picture per packet
+		{
+			decoded = true;
+			if (!output) continue;
+
+			// converts to BGR and scales streams sent at a reduced resolution back up, in one pass
+			_converter = sws_getCachedContext(_converter, _frame->width, _frame->height, (AVPixelFormat)_frame->format,
+				output->cols, output->rows, AV_PIX_FMT_BGR24, SWS_BILINEAR, NULL, NULL, NULL);
+			uint8_t* destination[1] = { output->data };
+			int destinationStride[1] = { (int)output->step[0] };
+			sws_scale(_converter, _frame->data, _frame->linesize, 0, _frame->height, destination, destinationStride);
+		}
+
+		return decoded;
+	}
+
+	void VideoDecoder::Reset()
+	{
+		avcodec_flush_buffers(_context);
+		_waitingForKeyframe = true;
+	}
+
+#else
+
+	VideoDecoder::VideoDecoder(const ChannelProperties* channelProperties) : _channelProperties(channelProperties), _context(NULL), _frame(NULL), _packet(NULL), _converter(NULL),
+		_waitingForKeyframe(true)
+	{
+		throw std::runtime_error("Can't decode " + channelProperties->ToString() + " - built without FFmpeg (see ProjectProperties/Tips.txt)");
+	}
+
+	VideoDecoder::~VideoDecoder()
+	{
+	}
+
+	bool VideoDecoder::Decode(const std::vector<unsigned char>& /*payload*/, cv::Mat* /*output*/)
+	{
+		return false;
+	}
+
+	void VideoDecoder::Reset()
+	{
+		_waitingForKeyframe = true;
+	}
+
+#endif
+}
@@ -0,0 +1,41 @@
+#pragma once
+
+#include "ChannelProperties.h"
+#include <opencv2/core/core.hpp>
+#include <vector>
+
+struct AVCodecContext;
+struct AVFrame;
+struct AVPacket;
+struct SwsContext;
+
+namespace Networking
+{
+	// decodes an H.264 or HEVC color stream, one access unit per packet, with libavcodec
+	// the decoder keeps its reference frames between packets, so it must see every packet in order - after joining a stream late, or after
+	// a reconnection, it drops packets until the next keyframe. Decoding is spread over several cores by slice threading, which (unlike frame
+	// threading) adds no frames of latency; it needs the encoder to split frames into slices (VideoEncoder does).
+	// Only available when built with FFmpeg (KINECT_CLIENT_WITH_FFMPEG, see FFmpeg.props) - otherwise the constructor throws.
+	class VideoDecoder
+	{
+		const ChannelProperties* _channelProperties; // not managed
+		AVCodecContext* _context;
+		AVFrame* _frame;
+		AVPacket* _packet;
+		SwsContext* _converter;
+		std::vector<unsigned char> _paddedPayload; // reused - libavcodec needs zeroed padding past the end of the data it's given
+		bool _waitingForKeyframe;
+
+	public:
+		VideoDecoder(const ChannelProperties* channelProperties);
+		~VideoDecoder();
+
+		// output - a full resolution BGR frame to convert the decoded picture into, or NULL to only keep the decoder's state up to date;
+		// returns false if no picture came out (waiting for a keyframe, or a corrupt packet)
+		bool Decode(const std::vector<unsigned char>& payload, cv::Mat* output);
+		void Reset(); // the stream was interrupted - drop everything until the next keyframe
+		bool WaitingForKeyframe() const { return _waitingForKeyframe; }
+
+		static bool IsKeyframe(const std::vector<unsigned char>& payload, enum ChannelType channelType); // looks for parameter sets / IDR slices
+	};
+}
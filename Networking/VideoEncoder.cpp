@@ -0,0 +1,104 @@
+#include "VideoEncoder.h"
+#include <stdexcept>
+#include <string>
+
+#ifdef KINECT_CLIENT_WITH_FFMPEG
+extern "C"
+{
+#include <libavcodec/avcodec.h>
+#include <libavutil/opt.h>
+#include <libswscale/swscale.h>
+}
+#endif
+
+namespace Networking
+{
+#ifdef KINECT_CLIENT_WITH_FFMPEG
+
+	const int KeyframeInterval = 60; // [frames] - a client that joins late waits at most this long (unless it asks for a keyframe)
+	const int SlicesPerFrame = 4;
+	const int BestConstantRateFactor = 18; // at JPEG quality 100
+	const int WorstConstantRateFactor = 38; // at JPEG quality 0
+
+	VideoEncoder::VideoEncoder(enum ChannelType channelType, int width, int height, unsigned char quality, int framesPerSecond) :
+		_context(NULL), _frame(NULL), _packet(NULL), _converter(NULL), _frameCount(0), _keyframeRequested(true)
+	{
+		AVCodec* codec = avcodec_find_encoder(channelType == ChannelType::ColorH264 ? AV_CODEC_ID_H264 : AV_CODEC_ID_HEVC);
+		if (!codec) throw std::runtime_error("FFmpeg was built without an encoder for " + ChannelProperties(channelType).ToString());
+
+		_context = avcodec_alloc_context3(codec);
+		_context->width = width;
+		_context->height = height;
+		_context->pix_fmt = AV_PIX_FMT_YUV420P;
+		_context->time_base = { 1, framesPerSecond };
+		_context->gop_size = KeyframeInterval;
+		_context->max_b_frames = 0;
+		_context->thread_count = 0;
+
+		int constantRateFactor = WorstConstantRateFactor - (WorstConstantRateFactor - BestConstantRateFactor) * quality / 100;
+		av_opt_set(_context->priv_data, "preset", "ultrafast", 0);
+		av_opt_set(_context->priv_data, "tune", "zerolatency", 0);
+		av_opt_set(_context->priv_data, "crf", std::to_string(constantRateFactor).c_str(), 0);
+		if (channelType == ChannelType::ColorH264) av_opt_set_int(_context->priv_data, "slices", SlicesPerFrame, 0);
+		else av_opt_set(_context->priv_data, "x265-params", "wpp=1", 0); // x265 parallelizes decoding by wavefronts rather than slices
+
+		if (avcodec_open2(_context, codec, NULL) < 0) throw std::runtime_error("Failed to open the encoder for " + ChannelProperties(channelType).ToString());
+
+		_frame = av_frame_alloc();
+		_frame->width = width;
+		_frame->height = height;
+		_frame->format = AV_PIX_FMT_YUV420P;
+		av_frame_get_buffer(_frame, 32);
+		_packet = av_packet_alloc();
+	}
+
+	VideoEncoder::~VideoEncoder()
+	{
+		sws_freeContext(_converter);
+		av_packet_free(&_packet);
+		av_frame_free(&_frame);
+		avcodec_free_context(&_context);
+	}
+
+	std::vector<unsigned char> VideoEncoder::Encode(const cv::Mat& frame)
+	{
+		_converter = sws_getCachedContext(_converter, frame.cols, frame.rows, AV_PIX_FMT_BGR24, _context->width, _context->height, AV_PIX_FMT_YUV420P, SWS_BILINEAR, NULL, NULL, NULL);
+		const uint8_t* source[1] = { frame.data };
+		int sourceStride[1] = { (int)frame.step[0] };
+		av_frame_make_writable(_frame);
+		sws_scale(_converter, source, sourceStride, 0, frame.rows, _frame->data, _frame->linesize);
+
+		_frame->pts = _frameCount++;
+		_frame->pict_type = _keyframeRequested ? AV_PICTURE_TYPE_I : AV_PICTURE_TYPE_NONE;
+		_keyframeRequested = false;
+
+		std::vector<unsigned char> encoded;
+		if (avcodec_send_frame(_context, _frame) < 0) throw std::runtime_error("Failed to encode a frame");
+		while (avcodec_receive_packet(_context, _packet) == 0) // zero latency - the frame's packet comes out right away
+		{
+			encoded.insert(encoded.end(), _packet->data, _packet->data + _packet->size);
+			av_packet_unref(_packet);
+		}
+
+		return encoded;
+	}
+
+#else
+
+	VideoEncoder::VideoEncoder(enum ChannelType channelType, int /*width*/, int /*height*/, unsigned char /*quality*/, int /*framesPerSecond*/) :
+		_context(NULL), _frame(NULL), _packet(NULL), _converter(NULL), _frameCount(0), _keyframeRequested(true)
+	{
+		throw std::runtime_error("Can't encode " + ChannelProperties(channelType).ToString() + " - built without FFmpeg (see ProjectProperties/Tips.txt)");
+	}
+
+	VideoEncoder::~VideoEncoder()
+	{
+	}
+
+	std::vector<unsigned char> VideoEncoder::Encode(const cv::Mat& /*frame*/)
+	{
+		return std::vector<unsigned char>();
+	}
+
+#endif
+}
@@ -0,0 +1,34 @@
+#pragma once
+
+#include "ChannelProperties.h"
+#include <opencv2/core/core.hpp>
+#include <vector>
+
+struct AVCodecContext;
+struct AVFrame;
+struct AVPacket;
+struct SwsContext;
+
+namespace Networking
+{
+	// encodes BGR frames into an H.264 or HEVC stream, one access unit per frame, for servers that stream video rather than JPEG
+	// (the ReplayServer, for testing). Tuned for latency: no B-frames, no lookahead, and frames split into slices so that the client can
+	// decode them on several cores. Quality follows the JPEG quality scale of the control messages (see ControlMessage).
+	// Only available when built with FFmpeg (KINECT_CLIENT_WITH_FFMPEG, see FFmpeg.props) - otherwise the constructor throws.
+	class VideoEncoder
+	{
+		AVCodecContext* _context;
+		AVFrame* _frame;
+		AVPacket* _packet;
+		SwsContext* _converter;
+		long long _frameCount;
+		bool _keyframeRequested;
+
+	public:
+		VideoEncoder(enum ChannelType channelType, int width, int height, unsigned char quality, int framesPerSecond);
+		~VideoEncoder();
+
+		std::vector<unsigned char> Encode(const cv::Mat& frame); // frame - BGR, of the size the encoder was created with
+		void RequestKeyframe() { _keyframeRequested = true; } // the next frame is encoded as a keyframe (a client joined or lost its references)
+	};
+}
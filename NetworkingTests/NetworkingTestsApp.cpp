@@ -0,0 +1,159 @@
+// Checks of the parts of the Networking library that need neither cameras nor a network. Prints a line per check,
+// and exits with a non-zero code if any of them failed.
+
+#include "Networking\ThreadBarrier.h"
+#include <iostream>
+#include <string>
+#include <vector>
+#include <algorithm>
+
+#include <windows.h>  // multithreading
+#include <process.h>  // multithreading
+
+using namespace std;
+
+#define CHECK_TIMEOUT 10000 // [ms], a check that hasn't finished by then is taken to be deadlocked
+#define REJOIN_ITERATIONS 50 // per session of the rejoining camera
+#define REJOIN_SESSIONS 2
+#define RECONNECTION_DELAY 20 // [ms] before every join of the rejoining camera
+#define GENERATION_ITERATIONS 1000
+
+#pragma region barrier checks
+
+// the places in the client's main loop where the threads meet
+enum BarrierSite
+{
+	ReceiveSite,
+	SynchronizeSite
+};
+
+struct BarrierCamera
+{
+	Networking::ThreadBarrier* Barrier;
+	volatile bool Active;
+	volatile LONG Iterations;
+	volatile bool Stop; // a camera with no session limit runs until this is raised
+	int Sessions; // 0 - a single session, until Stop
+};
+
+// goes through the barrier the way a camera thread of the client does: joins at the receive site (which counts as
+// entering it), meets the others at the synchronization site, and leaves when its connection is lost
+unsigned __stdcall BarrierCameraThreadFunction(void* barrierCamera)
+{
+	BarrierCamera* camera = (BarrierCamera*)barrierCamera;
+
+	for (int session = 0; session < max(camera->Sessions, 1); session++)
+	{
+		if (camera->Sessions > 0) Sleep(RECONNECTION_DELAY);
+		camera->Barrier->Join(ReceiveSite, &camera->Active);
+
+		for (int iteration = 0; camera->Sessions > 0 ? iteration < REJOIN_ITERATIONS : !camera->Stop; iteration++)
+		{
+			if (iteration > 0) camera->Barrier->Enter(ReceiveSite);
+			camera->Barrier->Enter(SynchronizeSite);
+			InterlockedIncrement(&camera->Iterations);
+		}
+
+		camera->Barrier->Leave(&camera->Active);
+	}
+
+	return 0;
+}
+
+// camera 0 streams on its own, camera 1 joins it, leaves, and rejoins - neither may be kept waiting for good
+bool CheckBarrierJoinLeaveRejoin()
+{
+	Networking::ThreadBarrier barrier;
+	BarrierCamera cameras[2] = { { &barrier, false, 0, false, 0 }, { &barrier, false, 0, false, REJOIN_SESSIONS } };
+
+	HANDLE threads[2];
+	threads[0] = (HANDLE)_beginthreadex(NULL, 0, &BarrierCameraThreadFunction, &cameras[0], 0, NULL);
+	while (cameras[0].Iterations == 0) Sleep(1); // camera 0 is a lone participant by the time camera 1 joins
+	threads[1] = (HANDLE)_beginthreadex(NULL, 0, &BarrierCameraThreadFunction, &cameras[1], 0, NULL);
+
+	bool rejoined = WaitForSingleObject(threads[1], CHECK_TIMEOUT) == WAIT_OBJECT_0;
+	cameras[0].Stop = true;
+	bool left = WaitForSingleObject(threads[0], CHECK_TIMEOUT) == WAIT_OBJECT_0;
+
+	bool passed = rejoined && left && cameras[1].Iterations == REJOIN_SESSIONS * REJOIN_ITERATIONS && !cameras[0].Active && !cameras[1].Active;
+	printf("%s - barrier join, leave and rejoin next to a lone participant (%d iterations of the rejoining camera, %d of the other)\n",
+		passed ? "passed" : "FAILED", (int)cameras[1].Iterations, (int)cameras[0].Iterations);
+
+	if (rejoined && left)
+	{
+		CloseHandle(threads[0]);
+		CloseHandle(threads[1]);
+	}
+	return passed;
+}
+
+struct GenerationCamera
+{
+	Networking::ThreadBarrier* Barrier;
+	volatile bool Active;
+	volatile bool Stop; // a camera with no iteration limit runs until this is raised
+	int Iterations; // 0 - until Stop
+	vector<unsigned long long> Generations; // of the phases passed at ReceiveSite
+};
+
+unsigned __stdcall GenerationCameraThreadFunction(void* generationCamera)
+{
+	GenerationCamera* camera = (GenerationCamera*)generationCamera;
+
+	camera->Generations.push_back(camera->Barrier->Join(ReceiveSite, &camera->Active));
+	for (int iteration = 1; camera->Iterations > 0 ? iteration < camera->Iterations : !camera->Stop; iteration++)
+	{
+		camera->Barrier->Enter(SynchronizeSite);
+		camera->Generations.push_back(camera->Barrier->Enter(ReceiveSite));
+	}
+	camera->Barrier->Leave(&camera->Active);
+
+	return 0;
+}
+
+// the client tells framesets apart by the generation its threads passed the barrier in - it has to be the same for all of them, and new every time
+bool CheckBarrierGenerations()
+{
+	Networking::ThreadBarrier barrier;
+	GenerationCamera cameras[2] = { { &barrier, false, false, 0 }, { &barrier, false, false, GENERATION_ITERATIONS } };
+
+	HANDLE threads[2];
+	threads[0] = (HANDLE)_beginthreadex(NULL, 0, &GenerationCameraThreadFunction, &cameras[0], 0, NULL);
+	while (!cameras[0].Active) Sleep(1);
+	threads[1] = (HANDLE)_beginthreadex(NULL, 0, &GenerationCameraThreadFunction, &cameras[1], 0, NULL);
+
+	bool finished = WaitForSingleObject(threads[1], CHECK_TIMEOUT) == WAIT_OBJECT_0;
+	cameras[0].Stop = true;
+	finished = WaitForSingleObject(threads[0], CHECK_TIMEOUT) == WAIT_OBJECT_0 && finished;
+
+	// camera 0 took part in every phase camera 1 passed, so it must have passed each of them with the same generation
+	int mismatches = 0;
+	for (size_t i = 0; finished && i < cameras[1].Generations.size(); i++)
+	{
+		unsigned long long generation = cameras[1].Generations[i];
+		if (i > 0 && generation <= cameras[1].Generations[i - 1]) mismatches++;
+		if (!binary_search(cameras[0].Generations.begin(), cameras[0].Generations.end(), generation)) mismatches++; // they grow
+	}
+
+	bool passed = finished && cameras[1].Generations.size() == GENERATION_ITERATIONS && mismatches == 0;
+	printf("%s - barrier generations shared by the participants of a phase (%d mismatches)\n", passed ? "passed" : "FAILED", mismatches);
+
+	if (finished)
+	{
+		CloseHandle(threads[0]);
+		CloseHandle(threads[1]);
+	}
+	return passed;
+}
+
+#pragma endregion
+
+int main(int argc, char** argv)
+{
+	int failures = 0;
+	if (!CheckBarrierJoinLeaveRejoin()) failures++;
+	if (!CheckBarrierGenerations()) failures++;
+
+	printf("%d check(s) failed\n", failures);
+	return failures > 0 ? 1 : 0;
+}
@@ -16,5 +16,8 @@ namespace Recording
 	protected:
 		BaseRecorder(const std::string& recordingPath, unsigned int recordingCycle, unsigned int cameraIndex) :
 			_recordingCycle(recordingCycle), _cameraIndex(cameraIndex), _recordingPath(recordingPath), _savedFramesCount(1) {}
+
+	public:
+		bool WantsFrame(unsigned int frameNumber) const { return _savedFramesCount * _recordingCycle < frameNumber; } // whether a frame this far into the session is due for recording
 	};
 }
@@ -0,0 +1,127 @@
+#include "CalibrationCoverage.h"
+
+#include <string>
+#include <limits>
+#include <algorithm>
+#include <cmath>
+
+namespace Recording
+{
+	const int CoverageGridCols = 8;
+	const int CoverageGridRows = 6;
+	const unsigned int MinimalNewlyCoveredCells = 2; // a pattern that reaches this many empty cells is worth recording
+	const float MinimalPoseDistance = 0.15f; // a pattern whose pose signature is at least this far from all recorded poses is worth recording
+
+	CalibrationCoverage::CalibrationCoverage(cv::Size boardSize) : _boardSize(boardSize), _imageSize(0, 0)
+	{
+		_coverageMap = cv::Mat::zeros(CoverageGridRows, CoverageGridCols, CV_32SC1);
+	}
+
+	void CalibrationCoverage::SetImageSize(cv::Size imageSize)
+	{
+		_imageSize = imageSize;
+	}
+
+	bool CalibrationCoverage::ImprovesCalibration(const std::vector<cv::Point2f>& corners) const
+	{
+		if (corners.size() != (size_t)_boardSize.area() || _imageSize.area() == 0)
+			return false;
+
+		if (_recordedPoses.empty())
+			return true;
+
+		return NewlyCoveredCells(corners) >= MinimalNewlyCoveredCells || DistanceToNearestRecordedPose(PoseSignature(corners)) >= MinimalPoseDistance;
+	}
+
+	void CalibrationCoverage::AddPattern(const std::vector<cv::Point2f>& corners)
+	{
+		if (corners.size() != (size_t)_boardSize.area() || _imageSize.area() == 0)
+			return;
+
+		for (auto& corner : corners)
+		{
+			cv::Point cell = CellOf(corner);
+			_coverageMap.at<int>(cell.y, cell.x)++;
+		}
+
+		_recordedPoses.push_back(PoseSignature(corners));
+	}
+
+	float CalibrationCoverage::CoveredFraction() const
+	{
+		return (float)cv::countNonZero(_coverageMap) / _coverageMap.total();
+	}
+
+	std::string CalibrationCoverage::ToString() const
+	{
+		std::string map;
+		for (int row = 0; row < _coverageMap.rows; row++)
+		{
+			for (int col = 0; col < _coverageMap.cols; col++)
+				map += _coverageMap.at<int>(row, col) ? '#' : '.';
+			map += '\n';
+		}
+
+		return std::to_string((int)(100 * CoveredFraction())) + "% of the image covered by " + std::to_string(_recordedPoses.size()) + " patterns\n" + map;
+	}
+
+	cv::Point CalibrationCoverage::CellOf(cv::Point2f corner) const
+	{
+		int col = (int)(corner.x * CoverageGridCols / _imageSize.width);
+		int row = (int)(corner.y * CoverageGridRows / _imageSize.height);
+
+		return cv::Point(std::min(std::max(col, 0), CoverageGridCols - 1), std::min(std::max(row, 0), CoverageGridRows - 1));
+	}
+
+	unsigned int CalibrationCoverage::NewlyCoveredCells(const std::vector<cv::Point2f>& corners) const
+	{
+		cv::Mat touched = cv::Mat::zeros(_coverageMap.size(), CV_8UC1);
+		unsigned int newlyCovered = 0;
+
+		for (auto& corner : corners)
+		{
+			cv::Point cell = CellOf(corner);
+			if (_coverageMap.at<int>(cell.y, cell.x) == 0 && !touched.at<uchar>(cell.y, cell.x))
+			{
+				touched.at<uchar>(cell.y, cell.x) = 1;
+				newlyCovered++;
+			}
+		}
+
+		return newlyCovered;
+	}
+
+	cv::Vec<float, 5> CalibrationCoverage::PoseSignature(const std::vector<cv::Point2f>& corners) const
+	{
+		// the outer corners of the board, in the row-major order findChessboardCorners reports them
+		cv::Point2f topLeft = corners[0];
+		cv::Point2f topRight = corners[_boardSize.width - 1];
+		cv::Point2f bottomLeft = corners[(_boardSize.height - 1) * _boardSize.width];
+		cv::Point2f bottomRight = corners[_boardSize.height * _boardSize.width - 1];
+
+		cv::Point2f center = (topLeft + topRight + bottomLeft + bottomRight) * 0.25f;
+
+		cv::Point2f outline[] = { topLeft, topRight, bottomRight, bottomLeft };
+		float area = 0; // shoelace formula over the board outline
+		for (int i = 0; i < 4; i++)
+			area += outline[i].cross(outline[(i + 1) % 4]);
+		float scale = std::sqrt(std::abs(area) / 2 / _imageSize.area());
+
+		// perspective foreshortening shows up as a difference between the lengths of opposite board edges
+		float top = (float)cv::norm(topRight - topLeft), bottom = (float)cv::norm(bottomRight - bottomLeft);
+		float left = (float)cv::norm(bottomLeft - topLeft), right = (float)cv::norm(bottomRight - topRight);
+		float tiltX = (right - left) / (right + left + std::numeric_limits<float>::epsilon());
+		float tiltY = (bottom - top) / (bottom + top + std::numeric_limits<float>::epsilon());
+
+		return cv::Vec<float, 5>(center.x / _imageSize.width, center.y / _imageSize.height, scale, tiltX, tiltY);
+	}
+
+	float CalibrationCoverage::DistanceToNearestRecordedPose(const cv::Vec<float, 5>& pose) const
+	{
+		float minDistance = std::numeric_limits<float>::max();
+		for (auto& recordedPose : _recordedPoses)
+			minDistance = std::min(minDistance, (float)cv::norm(pose - recordedPose));
+
+		return minDistance;
+	}
+}
@@ -0,0 +1,34 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <opencv2/core/core.hpp>
+
+namespace Recording
+{
+	// keeps track of where calibration pattern corners have landed in the image and of the board poses seen so far
+	// used to decide whether a newly detected pattern adds any information to the calibration
+	class CalibrationCoverage
+	{
+		cv::Size _boardSize;
+		cv::Size _imageSize;
+		cv::Mat _coverageMap; // number of recorded corners per grid cell (CV_32SC1, CoverageGridRows X CoverageGridCols)
+		std::vector<cv::Vec<float, 5>> _recordedPoses;
+
+	public:
+		CalibrationCoverage(cv::Size boardSize);
+
+		void SetImageSize(cv::Size imageSize); // must be called before the first pattern is evaluated or added
+		bool ImprovesCalibration(const std::vector<cv::Point2f>& corners) const; // true if the pattern covers new cells or shows the board in a new pose
+		void AddPattern(const std::vector<cv::Point2f>& corners);
+
+		float CoveredFraction() const; // fraction of grid cells that contain at least one recorded corner
+		std::string ToString() const;
+
+	private:
+		cv::Point CellOf(cv::Point2f corner) const;
+		unsigned int NewlyCoveredCells(const std::vector<cv::Point2f>& corners) const;
+		cv::Vec<float, 5> PoseSignature(const std::vector<cv::Point2f>& corners) const; // normalized center, scale and tilt of the board
+		float DistanceToNearestRecordedPose(const cv::Vec<float, 5>& pose) const;
+	};
+}
@@ -7,9 +7,11 @@
 namespace Recording
 {
 	const std::string PatternFilesSubDirectory("CalibrationFiles");
+	const unsigned int PatternsBetweenCalibrationEstimates = 3;
 
 	CalibrationPatternRecorder::CalibrationPatternRecorder(const std::string& recordingPath, unsigned int recordingCycle, unsigned int cameraIndex, unsigned int boardWidt, unsigned int boradHeight) :
-		BaseRecorder(recordingPath, recordingCycle, cameraIndex), _boardSize(cv::Size(boardWidt, boradHeight))
+		BaseRecorder(recordingPath, recordingCycle, cameraIndex), _boardSize(cv::Size(boardWidt, boradHeight)),
+		_coverage(_boardSize), _onlineCalibrator(_boardSize, cameraIndex, PatternsBetweenCalibrationEstimates)
 	{
 		_recordingPath = _recordingPath + std::string("/") + PatternFilesSubDirectory;
 		CreateDirectoryA(_recordingPath.c_str(), NULL);
@@ -22,12 +24,25 @@ namespace Recording
 
 	bool CalibrationPatternRecorder::DetectCalibrationPattern(cv::Mat frame, unsigned int frameNumber)
 	{
-		if (_savedFramesCount * _recordingCycle < frameNumber)
+		_coverage.SetImageSize(frame.size());
+		_onlineCalibrator.SetImageSize(frame.size());
+
+		if (WantsFrame(frameNumber))
 			return findChessboardCorners(frame, _boardSize, _currentPatternCorners, CV_CALIB_CB_ADAPTIVE_THRESH); // consider adding: CV_CALIB_CB_NORMALIZE_IMAGE
 
 		return false;
 	}
 
+	bool CalibrationPatternRecorder::DetectCalibrationPattern(Networking::LazyFrame& frame, unsigned int frameNumber)
+	{
+		return WantsFrame(frameNumber) && DetectCalibrationPattern(frame.Pixels(), frameNumber);
+	}
+
+	bool CalibrationPatternRecorder::LastPatternImprovesCalibration() const
+	{
+		return _coverage.ImprovesCalibration(_currentPatternCorners);
+	}
+
 	void CalibrationPatternRecorder::RecordLastCalibrationPattern()
 	{
 		char savedFrameCountString[10];
@@ -37,6 +52,10 @@ namespace Recording
 
 		std::cout << "~~~~~~~~~~~~~~~~~~~~ Camera " << _cameraIndex + 1 << ": Taking a shot ~~~~~~~~~~~~~~~~~~~~" << std::endl;
 
+		_coverage.AddPattern(_currentPatternCorners);
+		_onlineCalibrator.AddPattern(_currentPatternCorners);
+		std::cout << "Camera " << _cameraIndex + 1 << " coverage: " << _coverage.ToString();
+
 		if (_cameraIndex == 0) // don't want to waste resources on playing sound files in all threads
 			PlaySound(CameraShutterAudioFile.c_str(), NULL, SND_FILENAME | SND_ASYNC); // SND_ASYNC is important, otherwise this call will block
 
@@ -1,7 +1,10 @@
 #pragma once
 
+#include "Networking/LazyFrame.h" // first - brings in winsock2.h, which must come before windows.h
 #include "opencv2/highgui/highgui.hpp"
 #include "BaseRecorder.h"
+#include "CalibrationCoverage.h"
+#include "OnlineCalibrator.h"
 
 namespace Recording
 {
@@ -13,11 +16,16 @@ namespace Recording
 
 		cv::FileStorage _patternCornersFile;
 
+		CalibrationCoverage _coverage;
+		OnlineCalibrator _onlineCalibrator;
+
 	public:
 		CalibrationPatternRecorder(const std::string& recordingPath, unsigned int recordingCycle, unsigned int cameraIndex, unsigned int boardWidt, unsigned int boradHeight);
 		~CalibrationPatternRecorder();
 
 		bool DetectCalibrationPattern(cv::Mat frame, unsigned int frameNumber);
+		bool DetectCalibrationPattern(Networking::LazyFrame& frame, unsigned int frameNumber); // decodes the frame only when a pattern is due
+		bool LastPatternImprovesCalibration() const; // call after a successful detection - false if the pattern adds nothing to the corners and poses recorded so far
 		void RecordLastCalibrationPattern();
 	};
 }
\ No newline at end of file
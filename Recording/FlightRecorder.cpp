@@ -0,0 +1,155 @@
+#include "FlightRecorder.h"
+#include "Networking/VideoDecoder.h"
+#include "Networking/ThreadPlacement.h"
+#include <process.h>
+#include <stdio.h>
+#include <time.h>
+
+namespace Recording
+{
+	FlightRecorder::FlightRecorder(const std::string& recordingDirectory, unsigned int cameraCount, double window, size_t memoryBudget) :
+		_recordingDirectory(recordingDirectory), _window(window), _cameraBudget(memoryBudget / cameraCount), _rings(cameraCount), _dumpThread(NULL)
+	{
+		InitializeCriticalSection(&_lock);
+	}
+
+	FlightRecorder::~FlightRecorder()
+	{
+		if (_dumpThread)
+		{
+			WaitForSingleObject(_dumpThread, INFINITE);
+			CloseHandle(_dumpThread);
+		}
+		DeleteCriticalSection(&_lock);
+	}
+
+	void FlightRecorder::Record(unsigned int cameraIndex, Networking::ChannelType channelType, Networking::NetworkPacket& packet, double captureTime)
+	{
+		Entry entry{ packet.Timestamp, captureTime, std::make_shared<std::vector<unsigned char>>(std::move(packet.Data)) };
+		packet.Data.clear(); // moved from - make it empty for sure
+		std::vector<std::shared_ptr<const std::vector<unsigned char>>> evicted; // freed outside the lock
+
+		EnterCriticalSection(&_lock);
+
+		Ring& ring = _rings[cameraIndex];
+		ring.ChannelType = channelType;
+		ring.Bytes += entry.Data->size();
+		ring.Entries.push_back(std::move(entry));
+
+		while (ring.Entries.size() > 1 && (ring.Bytes > _cameraBudget || captureTime - ring.Entries.front().CaptureTime > _window))
+		{
+			ring.Bytes -= ring.Entries.front().Data->size();
+			evicted.push_back(ring.Entries.front().Data);
+			ring.Entries.pop_front();
+		}
+
+		LeaveCriticalSection(&_lock);
+	}
+
+	bool FlightRecorder::Trigger()
+	{
+		EnterCriticalSection(&_lock);
+
+		if (Dumping())
+		{
+			LeaveCriticalSection(&_lock);
+			return false;
+		}
+		if (_dumpThread) CloseHandle(_dumpThread);
+
+		time_t now = time(NULL);
+		tm localNow;
+		localtime_s(&localNow, &now);
+		char name[32];
+		strftime(name, sizeof(name), "/Flight_%Y%m%d_%H%M%S", &localNow);
+		_dumpDirectory = _recordingDirectory + name;
+
+		_dump = _rings; // only the payloads' reference counts - nothing is copied
+		_dumpThread = (HANDLE)_beginthreadex(NULL, 0, &DumpThreadFunction, this, 0, NULL);
+		SetThreadPriority(_dumpThread, THREAD_PRIORITY_BELOW_NORMAL); // the live streams come first
+
+		LeaveCriticalSection(&_lock);
+		return true;
+	}
+
+	bool FlightRecorder::Dumping() const
+	{
+		return _dumpThread && WaitForSingleObject(_dumpThread, 0) == WAIT_TIMEOUT;
+	}
+
+	std::string FlightRecorder::ToString() const
+	{
+		std::string description;
+		EnterCriticalSection(&_lock);
+		for (size_t i = 0; i < _rings.size(); i++)
+		{
+			const Ring& ring = _rings[i];
+			double span = ring.Entries.empty() ? 0 : (ring.Entries.back().CaptureTime - ring.Entries.front().CaptureTime) / 1000;
+			char line[128];
+			sprintf_s(line, "%scamera %d: %d packets, %2.1f [s], %2.1f [MB]", i ? ", " : "", (int)i, (int)ring.Entries.size(), span, ring.Bytes / 1e6);
+			description += line;
+		}
+		LeaveCriticalSection(&_lock);
+
+		return description;
+	}
+
+	unsigned __stdcall FlightRecorder::DumpThreadFunction(void* flightRecorder)
+	{
+		Networking::ThreadPlacement::PinGeneralThread(); // stay off the cores of the camera threads
+		((FlightRecorder*)flightRecorder)->Dump();
+		return 0;
+	}
+
+	void FlightRecorder::Dump()
+	{
+		CreateDirectoryA(_dumpDirectory.c_str(), NULL);
+		size_t packets = 0, bytes = 0;
+
+		for (size_t i = 0; i < _dump.size(); i++)
+		{
+			const Ring& ring = _dump[i];
+			if (ring.Entries.empty()) continue;
+
+			std::string cameraDirectory = _dumpDirectory + "/" + std::to_string(i);
+			CreateDirectoryA(cameraDirectory.c_str(), NULL);
+
+			// JPEG/PNG - a file per packet, as sent (depth in the server's units, not mm). Video - one stream, from the first keyframe on
+			bool video = Networking::ChannelProperties(ring.ChannelType).IsVideo();
+			const char* extension = ring.ChannelType == Networking::ChannelType::Color ? ".jpg" : ring.ChannelType == Networking::ChannelType::ColorH264 ? ".h264" :
+				ring.ChannelType == Networking::ChannelType::ColorHevc ? ".hevc" : ".png";
+			FILE* stream = NULL;
+			if (video) fopen_s(&stream, (cameraDirectory + "/stream" + extension).c_str(), "wb");
+			FILE* index = NULL;
+			fopen_s(&index, (cameraDirectory + "/index.txt").c_str(), "w");
+			if (index) fprintf(index, "# packet, seconds, milliseconds (server clock), capture time [ms] (client clock), bytes\n");
+
+			size_t first = 0;
+			while (video && first < ring.Entries.size() && !Networking::VideoDecoder::IsKeyframe(*ring.Entries[first].Data, ring.ChannelType)) first++;
+
+			for (size_t j = first; j < ring.Entries.size(); j++)
+			{
+				const Entry& entry = ring.Entries[j];
+				FILE* file = stream;
+				if (!video)
+				{
+					char fileName[16];
+					sprintf_s(fileName, "/%06d", (int)(j - first));
+					fopen_s(&file, (cameraDirectory + fileName + extension).c_str(), "wb");
+				}
+				if (file) fwrite(entry.Data->data(), 1, entry.Data->size(), file);
+				if (file && !video) fclose(file);
+
+				if (index) fprintf(index, "%d %ld %ld %.1f %d\n", (int)(j - first), entry.Timestamp.Seconds, entry.Timestamp.Milliseconds, entry.CaptureTime, (int)entry.Data->size());
+				packets++;
+				bytes += entry.Data->size();
+			}
+
+			if (stream) fclose(stream);
+			if (index) fclose(index);
+		}
+
+		_dump.clear(); // lets go of the payloads that already left the window
+		printf("Flight recorder: wrote %d packets (%2.1f [MB]) to %s\n", (int)packets, bytes / 1e6, _dumpDirectory.c_str());
+	}
+}
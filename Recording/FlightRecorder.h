@@ -0,0 +1,59 @@
+#pragma once
+
+#include "Networking/PacketClient.h" // first - brings in winsock2.h, which must come before windows.h
+#include <deque>
+#include <memory>
+#include <string>
+#include <vector>
+#include <windows.h>
+
+namespace Recording
+{
+	// keeps the last seconds of every camera's stream in memory, as received - nothing is decoded, and the payloads are taken over from
+	// the packets rather than copied. When triggered (a key, Ctrl+Break, or Trigger()), the window is written to disk by a thread of its
+	// own while the streams carry on; the packets being written stay alive for it even once they leave the window.
+	// Every camera gets an equal share of the memory budget, so a heavy stream can't push the others out. Thread safe.
+	class FlightRecorder
+	{
+		struct Entry
+		{
+			Networking::Timestamp Timestamp;
+			double CaptureTime; // [ms] on the client's clock (see ClockModel)
+			std::shared_ptr<const std::vector<unsigned char>> Data;
+		};
+
+		struct Ring
+		{
+			std::deque<Entry> Entries;
+			size_t Bytes;
+			Networking::ChannelType ChannelType;
+
+			Ring() : Bytes(0), ChannelType(Networking::ChannelType::Color) {}
+		};
+
+		std::string _recordingDirectory;
+		double _window; // [ms]
+		size_t _cameraBudget; // [bytes]
+		std::vector<Ring> _rings;
+		mutable CRITICAL_SECTION _lock;
+
+		HANDLE _dumpThread; // NULL until the first dump
+		std::vector<Ring> _dump; // what the running dump writes - shares the payloads with _rings
+		std::string _dumpDirectory;
+
+	public:
+		FlightRecorder(const std::string& recordingDirectory, unsigned int cameraCount, double window, size_t memoryBudget); // window [ms], memoryBudget [bytes]
+		~FlightRecorder(); // waits for a running dump to finish
+
+		// takes the packet's payload - packet.Data is empty afterwards, so this comes once nothing else needs it
+		void Record(unsigned int cameraIndex, Networking::ChannelType channelType, Networking::NetworkPacket& packet, double captureTime);
+		bool Trigger(); // starts a dump of what is held now; false if the previous one is still being written
+		bool Dumping() const;
+
+		std::string ToString() const; // how much each camera holds
+
+	private:
+		static unsigned __stdcall DumpThreadFunction(void* flightRecorder);
+		void Dump();
+	};
+}
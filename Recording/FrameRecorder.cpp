@@ -12,7 +12,7 @@ namespace Recording
 		_recordingPath = _recordingPath + std::string("/") + cameraIndexString;
 		CreateDirectoryA(_recordingPath.c_str(), NULL);
 
-		if (_channelProperties->ChannelType == Networking::ChannelType::Color)
+		if (_channelProperties->IsColor())
 			_imageFileType = ".jpg";
 		else
 			_imageFileType = ".png";
@@ -20,7 +20,7 @@ namespace Recording
 
 	void FrameRecorder::RecordFrame(cv::Mat frame, unsigned int frameNumber)
 	{
-		if (_savedFramesCount * _recordingCycle < frameNumber) // (pressedKey == 32) // 32 is the spacebar // 
+		if (WantsFrame(frameNumber)) // (pressedKey == 32) // 32 is the spacebar // 
 		{
 			char savedFrameCountString[10];
 			sprintf_s(savedFrameCountString, "%02d", _savedFramesCount); // assuming savedFrameCount < 100, 2 digits should suffice
@@ -34,4 +34,9 @@ namespace Recording
 			_savedFramesCount++;
 		}
 	}
+
+	void FrameRecorder::RecordFrame(Networking::LazyFrame& frame, unsigned int frameNumber)
+	{
+		if (WantsFrame(frameNumber)) RecordFrame(frame.Pixels(), frameNumber);
+	}
 }
\ No newline at end of file
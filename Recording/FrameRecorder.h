@@ -3,6 +3,7 @@
 #include <string>
 #include <opencv2/highgui/highgui.hpp>
 #include "Networking/ChannelProperties.h"
+#include "Networking/LazyFrame.h"
 #include "BaseRecorder.h"
 
 namespace Recording
@@ -16,6 +17,7 @@ namespace Recording
 		FrameRecorder(const std::string& recordingDirectory, const Networking::ChannelProperties* channelProperties, unsigned int recordingCycle, unsigned int cameraIndex);
 
 		void RecordFrame(cv::Mat frame, unsigned int frameNumber);
+		void RecordFrame(Networking::LazyFrame& frame, unsigned int frameNumber); // decodes the frame only when it is due
 
 	private:
 		std::string _imageFileType;
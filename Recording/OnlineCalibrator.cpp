@@ -0,0 +1,114 @@
+#include "opencv2/core/core.hpp"
+#include "Networking/ThreadPlacement.h" // includes winsock2.h, which must precede windows.h
+#include "OnlineCalibrator.h"
+
+#include "opencv2/calib3d/calib3d.hpp"
+#include <process.h> // multithreading
+#include <iostream>
+
+namespace Recording
+{
+	const unsigned int MinimalPatternsForSolve = 4; // fewer views than that can't constrain the focal length, principal point and distortion
+
+	OnlineCalibrator::OnlineCalibrator(cv::Size boardSize, unsigned int cameraIndex, unsigned int patternsBetweenSolves) :
+		_boardSize(boardSize), _imageSize(0, 0), _cameraIndex(cameraIndex), _patternsBetweenSolves(patternsBetweenSolves), _solverThread(NULL), _reprojectionError(-1)
+	{
+		InitializeCriticalSection(&_lock);
+	}
+
+	OnlineCalibrator::~OnlineCalibrator()
+	{
+		if (_solverThread)
+		{
+			WaitForSingleObject(_solverThread, INFINITE);
+			CloseHandle(_solverThread);
+		}
+
+		DeleteCriticalSection(&_lock);
+	}
+
+	void OnlineCalibrator::SetImageSize(cv::Size imageSize)
+	{
+		_imageSize = imageSize;
+	}
+
+	void OnlineCalibrator::AddPattern(const std::vector<cv::Point2f>& corners)
+	{
+		_patterns.push_back(corners);
+
+		if (_patterns.size() < MinimalPatternsForSolve || _patterns.size() % _patternsBetweenSolves != 0 || _imageSize.area() == 0)
+			return;
+
+		if (SolverBusy())
+		{
+			std::cout << "Camera " << _cameraIndex + 1 << ": previous calibration estimate is still being computed, skipping this one" << std::endl;
+			return;
+		}
+
+		if (_solverThread) CloseHandle(_solverThread);
+
+		_solverPatterns = _patterns; // the solver works on a snapshot, so the capturing thread never waits for it
+		_solverThread = (HANDLE)_beginthreadex(NULL, 0, &SolverThreadFunction, this, 0, NULL);
+	}
+
+	double OnlineCalibrator::LastReprojectionError()
+	{
+		EnterCriticalSection(&_lock);
+		double reprojectionError = _reprojectionError;
+		LeaveCriticalSection(&_lock);
+
+		return reprojectionError;
+	}
+
+	bool OnlineCalibrator::SolverBusy()
+	{
+		return _solverThread && WaitForSingleObject(_solverThread, 0) == WAIT_TIMEOUT;
+	}
+
+	unsigned __stdcall OnlineCalibrator::SolverThreadFunction(void* calibrator)
+	{
+		Networking::ThreadPlacement::PinGeneralThread(); // stay off the cores of the camera threads
+		((OnlineCalibrator*)calibrator)->Solve();
+		return 0;
+	}
+
+	void OnlineCalibrator::Solve()
+	{
+		// the RMS error is measured in pixels, so the physical size of the squares doesn't matter here
+		std::vector<cv::Point3f> boardCorners;
+		for (int i = 0; i < _boardSize.height; i++)
+			for (int j = 0; j < _boardSize.width; j++)
+				boardCorners.push_back(cv::Point3f((float)j, (float)i, 0));
+		std::vector<std::vector<cv::Point3f>> objectPoints(_solverPatterns.size(), boardCorners);
+
+		EnterCriticalSection(&_lock);
+		cv::Mat cameraMatrix = _cameraMatrix.clone();
+		cv::Mat distortionCoeffs = _distortionCoeffs.clone();
+		LeaveCriticalSection(&_lock);
+
+		int flags = CV_CALIB_ZERO_TANGENT_DIST | CV_CALIB_FIX_K3; // same model as the offline calibration in CameraCalibratorApp
+		if (!cameraMatrix.empty()) flags |= CV_CALIB_USE_INTRINSIC_GUESS; // warm start from the previous estimate
+
+		std::vector<cv::Mat> rotations, translations;
+		double reprojectionError;
+		try
+		{
+			reprojectionError = cv::calibrateCamera(objectPoints, _solverPatterns, _imageSize, cameraMatrix, distortionCoeffs, rotations, translations, flags);
+		}
+		catch (const cv::Exception& e)
+		{
+			std::cout << "Camera " << _cameraIndex + 1 << ": calibration estimate failed - " << e.what() << std::endl;
+			return;
+		}
+
+		EnterCriticalSection(&_lock);
+		_reprojectionError = reprojectionError;
+		_cameraMatrix = cameraMatrix;
+		_distortionCoeffs = distortionCoeffs;
+		LeaveCriticalSection(&_lock);
+
+		std::cout << "Camera " << _cameraIndex + 1 << ": calibration estimate from " << _solverPatterns.size() << " patterns - reprojection error " << reprojectionError 
+			<< ", fx " << cameraMatrix.at<double>(0, 0) << ", fy " << cameraMatrix.at<double>(1, 1) 
+			<< ", cx " << cameraMatrix.at<double>(0, 2) << ", cy " << cameraMatrix.at<double>(1, 2) << std::endl;
+	}
+}
@@ -0,0 +1,42 @@
+#pragma once
+
+#include <vector>
+#include <opencv2/core/core.hpp>
+#include <windows.h>
+
+namespace Recording
+{
+	// re-estimates the intrinsic calibration of a single camera on a background thread while patterns are still being captured
+	// the estimate is only used as feedback for the operator - the final calibration is still done offline by the CameraCalibrator
+	class OnlineCalibrator
+	{
+		cv::Size _boardSize;
+		cv::Size _imageSize;
+		unsigned int _cameraIndex;
+		unsigned int _patternsBetweenSolves;
+
+		std::vector<std::vector<cv::Point2f>> _patterns; // accessed only by the capturing thread
+		
+		// state shared with the solver thread
+		CRITICAL_SECTION _lock;
+		HANDLE _solverThread;
+		std::vector<std::vector<cv::Point2f>> _solverPatterns;
+		double _reprojectionError;
+		cv::Mat _cameraMatrix;
+		cv::Mat _distortionCoeffs;
+
+	public:
+		OnlineCalibrator(cv::Size boardSize, unsigned int cameraIndex, unsigned int patternsBetweenSolves);
+		~OnlineCalibrator(); // waits for a solve in progress
+
+		void SetImageSize(cv::Size imageSize);
+		void AddPattern(const std::vector<cv::Point2f>& corners); // kicks off a background solve every patternsBetweenSolves patterns (unless one is already running)
+
+		double LastReprojectionError(); // negative until the first solve completes
+
+	private:
+		bool SolverBusy();
+		static unsigned __stdcall SolverThreadFunction(void* calibrator);
+		void Solve();
+	};
+}
@@ -0,0 +1,346 @@
+// A local stand-in for the servers on the Jetson boards - streams frames recorded by the client (FrameRecorder) over the same protocol,
+// and honours the control messages the client sends back (JPEG quality, frame rate and resolution). Lets the client be tested without boards.
+// Color can also be streamed as H.264 or HEVC (-codec, needs FFmpeg - see ProjectProperties/Tips.txt), or as JPEGs the client can decode
+// on several cores (-bands, -restart - see ParallelJpegDecoder).
+
+#include <opencv2\highgui\highgui.hpp>
+#include <opencv2\imgproc\imgproc.hpp>
+#include <iostream>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <memory>
+
+#include "Networking\ChannelProperties.h"
+#include "Networking\ControlMessage.h"
+#include "Networking\VideoEncoder.h"
+
+#include <winsock2.h>
+#include <windows.h>  // multithreading
+#include <process.h>  // multithreading
+#include <sys\timeb.h> // timestamps
+
+using namespace std;
+using namespace cv;
+
+#define PORT 3490 // by default camera i is served on PORT + i (the client connects this way when given -host)
+#define RECORDING_DIRECTORY "../Data" // frames of camera i are read from RECORDING_DIRECTORY/i, as written by FrameRecorder
+#define MAX_NUMBER_OF_CAMERAS 4
+#define FRAME_PERIOD 33 // [ms], the Kinect runs at 30 Hz
+#define JPEG_MCU_SIZE 16 // [pixels], OpenCV codes color JPEGs with 4:2:0 chroma subsampling
+
+#pragma region Globals
+
+struct ReplayStream
+{
+	unsigned int CameraIndex;
+	Networking::ChannelType ChannelType;
+	vector<Mat> Frames; // in the units the server sends (for depth - DepthResolution, not mm)
+};
+
+ReplayStream Streams[MAX_NUMBER_OF_CAMERAS];
+Networking::ChannelType ColorChannelType = Networking::ChannelType::Color; // how color streams are coded - JPEG per frame, or video
+int JpegBands = 1; // color JPEGs are coded as this many horizontal bands, sent one after the other in the same packet
+bool JpegRestartMarkers = false; // color JPEGs get a restart marker at the start of every MCU row
+int BasePort = PORT; // camera i is served on BasePort + i
+
+#pragma endregion
+
+unsigned __stdcall ReplayServerThreadFunction(void* stream); // implemented below
+bool LoadRecording(const string& directory, ReplayStream& stream); // implemented below
+
+int main(int argc, char** argv)
+{
+#pragma region process input arguments
+
+	if (argc < 2)
+	{
+		cout << "usage: " << argv[0] << " n [directory] [-codec h264|hevc] [-bands n] [-restart] [-port base]" << endl
+			<< "n - a mandatory parameter, specifies the number of cameras to serve" << endl
+			<< "[directory] - an optional path to the recordings (default " << RECORDING_DIRECTORY << ")" << endl
+			<< "[-codec h264|hevc] - an optional video codec for the color streams (default - JPEG per frame)" << endl
+			<< "[-bands n] - an optional number of horizontal bands each color JPEG is coded as, decoded in parallel by the client" << endl
+			<< "[-restart] - an optional flag that puts a restart marker at the start of every MCU row of the color JPEGs, where the client can split them" << endl
+			<< "[-port base] - an optional port to serve camera i on base + i (default " << PORT << "), e.g. behind an ImpairmentProxy on the same host" << endl;
+		return 1;
+	}
+
+	unsigned int cameraCount = atoi(argv[1]);
+	if (cameraCount > MAX_NUMBER_OF_CAMERAS) throw runtime_error("Currently only supporting up to " + std::to_string(MAX_NUMBER_OF_CAMERAS) + " cameras.");
+	string directory = RECORDING_DIRECTORY;
+
+	for (int argIndex = 2; argIndex < argc; argIndex++)
+	{
+		if (_strcmpi(argv[argIndex], "-codec") == 0 && argIndex + 1 < argc)
+		{
+			argIndex++;
+			if (_strcmpi(argv[argIndex], "h264") == 0) ColorChannelType = Networking::ChannelType::ColorH264;
+			else if (_strcmpi(argv[argIndex], "hevc") == 0) ColorChannelType = Networking::ChannelType::ColorHevc;
+			else throw runtime_error(string("Unknown codec ") + argv[argIndex]);
+		}
+		else if (_strcmpi(argv[argIndex], "-bands") == 0 && argIndex + 1 < argc)
+		{
+			JpegBands = atoi(argv[++argIndex]);
+			if (JpegBands < 1) throw runtime_error("The number of bands has to be positive");
+		}
+		else if (_strcmpi(argv[argIndex], "-restart") == 0)
+		{
+			JpegRestartMarkers = true;
+		}
+		else if (_strcmpi(argv[argIndex], "-port") == 0 && argIndex + 1 < argc)
+		{
+			BasePort = atoi(argv[++argIndex]);
+		}
+		else
+		{
+			directory = argv[argIndex];
+		}
+	}
+
+#pragma endregion
+
+#pragma region load recordings
+
+	for (unsigned int i = 0; i < cameraCount; i++)
+	{
+		Streams[i].CameraIndex = i;
+		if (!LoadRecording(directory + "/" + to_string(i), Streams[i]))
+		{
+			cout << "No recorded frames found for camera " << i << " in " << directory << endl;
+			return 1;
+		}
+		cout << "Camera " << i << ": " << Streams[i].Frames.size() << " frames, " << Networking::ChannelProperties(Streams[i].ChannelType).ToString() << endl;
+	}
+
+#pragma endregion
+
+#pragma region launch threads
+
+	WSADATA wsaData;
+	if (WSAStartup(MAKEWORD(2, 2), &wsaData) != 0)
+	{
+		cout << "WSAStartup failed" << endl;
+		return 1;
+	}
+
+	vector<HANDLE> handlesToThreads;
+	for (unsigned int i = 0; i < cameraCount; i++)
+		handlesToThreads.push_back((HANDLE)_beginthreadex(NULL, 0, &ReplayServerThreadFunction, &Streams[i], 0, NULL));
+
+	WaitForMultipleObjects((DWORD)handlesToThreads.size(), &handlesToThreads[0], TRUE, INFINITE);
+	WSACleanup();
+
+#pragma endregion
+
+	return 0;
+}
+
+bool LoadRecording(const string& directory, ReplayStream& stream)
+{
+	vector<string> fileNames;
+	WIN32_FIND_DATAA findData;
+	HANDLE search = FindFirstFileA((directory + "/*.*").c_str(), &findData);
+	if (search == INVALID_HANDLE_VALUE) return false;
+
+	do
+	{
+		if (!(findData.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY)) fileNames.push_back(findData.cFileName);
+	} while (FindNextFileA(search, &findData));
+	FindClose(search);
+
+	sort(fileNames.begin(), fileNames.end()); // FrameRecorder names the files by their (zero padded) order
+
+	for (auto& fileName : fileNames)
+	{
+		Mat frame = imread(directory + "/" + fileName, IMREAD_UNCHANGED);
+		if (frame.empty()) continue;
+
+		if (frame.depth() == CV_16U)
+		{
+			stream.ChannelType = Networking::ChannelType::Depth;
+			Networking::ChannelProperties channelProperties(stream.ChannelType);
+			frame.convertTo(frame, CV_16U, 1 / channelProperties.DepthResolution); // FrameRecorder saves depth in mm
+		}
+		else
+		{
+			stream.ChannelType = frame.channels() == 3 ? ColorChannelType : Networking::ChannelType::Ir;
+		}
+
+		stream.Frames.push_back(frame);
+	}
+
+	return !stream.Frames.empty();
+}
+
+#pragma region streaming
+
+bool SendAll(SOCKET connection, const char* buffer, int length)
+{
+	for (int sent = 0; sent < length; )
+	{
+		int result = send(connection, buffer + sent, length - sent, 0);
+		if (result == SOCKET_ERROR) return false;
+		sent += result;
+	}
+
+	return true;
+}
+
+// reads whatever control messages have arrived, without blocking; returns false if the client is gone
+bool ReceiveControlMessages(SOCKET connection, vector<unsigned char>& pending, Networking::ControlMessage& settings, bool& keyframeRequested, unsigned int cameraIndex)
+{
+	while (true)
+	{
+		fd_set readable;
+		FD_ZERO(&readable);
+		FD_SET(connection, &readable);
+		timeval noWait = { 0, 0 };
+		if (select(0, &readable, NULL, NULL, &noWait) <= 0) return true;
+
+		unsigned char buffer[Networking::BytesInControlMessage];
+		int received = recv(connection, (char*)buffer, Networking::BytesInControlMessage - (int)pending.size(), 0);
+		if (received <= 0) return false;
+		pending.insert(pending.end(), buffer, buffer + received);
+
+		if (pending.size() == Networking::BytesInControlMessage)
+		{
+			Networking::ControlMessage message;
+			try
+			{
+				message = Networking::ControlMessage::Deserialize(&pending[0]);
+			}
+			catch (const exception& e) // not a client of ours, or out of step with the messages - drop it, and wait for the next one (the client reconnects)
+			{
+				printf("Camera %d: dropping the client - %s\n", cameraIndex, e.what());
+				return false;
+			}
+			pending.clear();
+			if (message.Type == Networking::ControlMessageType::KeyframeRequest)
+			{
+				keyframeRequested = true;
+				continue;
+			}
+
+			settings = message;
+			printf("Camera %d: client reports queue depth %d, decode time %2.1f [ms], latency %d [ms] - streaming at quality %d, every %d frame(s), 1/%d resolution\n",
+				cameraIndex, settings.QueueDepth, settings.DecodeTime, settings.EstimatedLatency, settings.JpegQuality, settings.FrameRateDivider, settings.ResolutionDivider);
+		}
+	}
+}
+
+vector<uchar> EncodeJpeg(const Mat& frame, int quality)
+{
+	vector<int> parameters{ IMWRITE_JPEG_QUALITY, quality };
+	if (JpegRestartMarkers) // an interval of one MCU row
+		parameters.insert(parameters.end(), { IMWRITE_JPEG_RST_INTERVAL, (frame.cols + JPEG_MCU_SIZE - 1) / JPEG_MCU_SIZE });
+
+	// every band a JPEG of its own, all but the last a whole number of MCU rows high
+	int bandHeight = ((frame.rows + JpegBands - 1) / JpegBands + JPEG_MCU_SIZE - 1) / JPEG_MCU_SIZE * JPEG_MCU_SIZE;
+	vector<uchar> encoded, band;
+	for (int firstRow = 0; firstRow < frame.rows; firstRow += bandHeight)
+	{
+		imencode(".jpg", frame.rowRange(firstRow, min(firstRow + bandHeight, frame.rows)), band, parameters);
+		encoded.insert(encoded.end(), band.begin(), band.end());
+	}
+
+	return encoded;
+}
+
+vector<uchar> EncodeFrame(const Mat& frame, Networking::ChannelType channelType, const Networking::ControlMessage& settings, unique_ptr<Networking::VideoEncoder>& videoEncoder)
+{
+	Mat scaledFrame = frame;
+	if (settings.ResolutionDivider > 1)
+		resize(frame, scaledFrame, Size(frame.cols / settings.ResolutionDivider, frame.rows / settings.ResolutionDivider), 0, 0,
+			channelType == Networking::ChannelType::Depth ? INTER_NEAREST : INTER_AREA); // don't blend invalid depth pixels
+
+	vector<uchar> encoded;
+	if (channelType == Networking::ChannelType::ColorH264 || channelType == Networking::ChannelType::ColorHevc)
+		encoded = videoEncoder->Encode(scaledFrame);
+	else if (channelType == Networking::ChannelType::Color)
+		encoded = EncodeJpeg(scaledFrame, settings.JpegQuality);
+	else
+		imencode(".png", scaledFrame, encoded);
+
+	return encoded;
+}
+
+unsigned __stdcall ReplayServerThreadFunction(void* replayStream)
+{
+	ReplayStream* stream = (ReplayStream*)replayStream;
+
+	SOCKET listeningSocket = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+	sockaddr_in address = { 0 };
+	address.sin_family = AF_INET;
+	address.sin_addr.s_addr = htonl(INADDR_ANY);
+	address.sin_port = htons((u_short)(BasePort + stream->CameraIndex));
+	if (bind(listeningSocket, (sockaddr*)&address, sizeof(address)) == SOCKET_ERROR || listen(listeningSocket, 1) == SOCKET_ERROR)
+	{
+		printf("Camera %d: failed to listen on port %d: %d\n", stream->CameraIndex, BasePort + stream->CameraIndex, WSAGetLastError());
+		return 1;
+	}
+
+	while (true) // serve one client at a time, and wait for the next one when it leaves
+	{
+		printf("Camera %d: waiting for a client on port %d\n", stream->CameraIndex, BasePort + stream->CameraIndex);
+		SOCKET connection = accept(listeningSocket, NULL, NULL);
+		if (connection == INVALID_SOCKET) continue;
+
+		Networking::ControlMessage settings; // full quality until the client asks otherwise
+		Networking::ControlMessage encoderSettings;
+		unique_ptr<Networking::VideoEncoder> videoEncoder; // a new one for every client, which then starts with a keyframe
+		bool keyframeRequested = false;
+		vector<unsigned char> pendingControlBytes;
+		char metadata = (char)stream->ChannelType;
+		bool connected = SendAll(connection, &metadata, 1);
+
+		LARGE_INTEGER frequency, nextFrameTime, now;
+		QueryPerformanceFrequency(&frequency);
+		QueryPerformanceCounter(&nextFrameTime);
+
+		for (size_t frameIndex = 0; connected; frameIndex += settings.FrameRateDivider) // a lower frame rate skips frames, like a camera would
+		{
+			connected = ReceiveControlMessages(connection, pendingControlBytes, settings, keyframeRequested, stream->CameraIndex);
+
+			if (stream->ChannelType == Networking::ChannelType::ColorH264 || stream->ChannelType == Networking::ChannelType::ColorHevc)
+			{
+				// the encoder is opened for one resolution, quality and frame rate (its rate control depends on it) - a change of any starts it over (with a keyframe)
+				if (!videoEncoder || settings.JpegQuality != encoderSettings.JpegQuality || settings.ResolutionDivider != encoderSettings.ResolutionDivider ||
+					settings.FrameRateDivider != encoderSettings.FrameRateDivider)
+				{
+					const Mat& frame = stream->Frames[0];
+					videoEncoder.reset(new Networking::VideoEncoder(stream->ChannelType, frame.cols / settings.ResolutionDivider, frame.rows / settings.ResolutionDivider,
+						settings.JpegQuality, 1000 / (FRAME_PERIOD * settings.FrameRateDivider)));
+					encoderSettings = settings;
+				}
+				if (keyframeRequested) videoEncoder->RequestKeyframe();
+				keyframeRequested = false;
+			}
+
+			vector<uchar> encoded = EncodeFrame(stream->Frames[frameIndex % stream->Frames.size()], stream->ChannelType, settings, videoEncoder);
+
+			if (!encoded.empty()) // an encoder may hold a frame back (or not be built in) - an empty payload would read as a lost connection
+			{
+				struct __timeb64 time;
+				_ftime64_s(&time);
+				long timestamp[2] = { (long)time.time, (long)time.millitm }; // 4 byte seconds and milliseconds, like the Jetson server
+				unsigned char header[3] = { (unsigned char)(encoded.size() & 0xFF), (unsigned char)((encoded.size() >> 8) & 0xFF), (unsigned char)((encoded.size() >> 16) & 0xFF) };
+
+				connected = connected && SendAll(connection, (char*)timestamp, sizeof(timestamp)) && SendAll(connection, (char*)header, sizeof(header)) &&
+					SendAll(connection, (char*)&encoded[0], (int)encoded.size());
+			}
+
+			// pace the stream like the camera would
+			nextFrameTime.QuadPart += frequency.QuadPart * FRAME_PERIOD * settings.FrameRateDivider / 1000;
+			QueryPerformanceCounter(&now);
+			if (now.QuadPart < nextFrameTime.QuadPart)
+				Sleep((DWORD)(1000 * (nextFrameTime.QuadPart - now.QuadPart) / frequency.QuadPart));
+			else
+				nextFrameTime = now; // fell behind (e.g. a slow client) - don't try to catch up with a burst
+		}
+
+		printf("Camera %d: client disconnected\n", stream->CameraIndex);
+		closesocket(connection);
+	}
+}
+
+#pragma endregion